@@ -85,7 +85,7 @@ UPDATE_METHOD = afs
 # A list of the test programs you want compiled in from the 410user/progs
 # directory
 #
-410TESTS = startle actual_wait thr_exit_join
+410TESTS = startle actual_wait thr_exit_join rwlock_downgrade_read_test
 
 ###########################################################################
 # Test programs you have written which you wish to run
@@ -93,12 +93,19 @@ UPDATE_METHOD = afs
 # A list of the test programs you want compiled in from the user/progs
 # directory
 #
-STUDENTTESTS = test test_fork test_new_pages test_thread_fork test_thread_create
+STUDENTTESTS = test test_fork test_new_pages test_thread_fork test_thread_create \
+			   tcb_lookup_bench join_bench create_n_bench \
+			   thrpool_bench sem_bench rwlock_read_bench \
+			   rwlock_policy_bench
 
 ###########################################################################
 # Object files for your thread library
 ###########################################################################
-THREAD_OBJS = malloc.o panic.o thread_fork.o thread_library_main.o
+THREAD_OBJS = malloc.o panic.o thread_fork.o thread_library_main.o atomic.o \
+			  spinlock.o tcb_registry.o thr_stack.o thread_vanish.o thr_park.o \
+			  thrpool.o forkjoin.o ctx_switch.o green.o future.o \
+			  parallel.o coroutine.o tls.o mutex.o cond.o sem.o rwlock.o \
+			  barrier.o latch.o
 
 # Thread Group Library Support.
 #
@@ -114,7 +121,7 @@ THREAD_OBJS = malloc.o panic.o thread_fork.o thread_library_main.o
 SYSCALL_OBJS = syscall.o set_status.o vanish.o print.o getchar.o set_term_color.o \
 			   set_cursor_pos.o get_cursor_pos.o readline.o task_vanish.o wait.o exec.o fork.o \
 			   gettid.o yield.o deschedule.o make_runnable.o get_ticks.o sleep.o new_pages.o \
-			   remove_pages.o
+			   remove_pages.o swexn.o
 
 ###########################################################################
 # Object files for your automatic stack handling
@@ -0,0 +1,39 @@
+/** @file barrier.h
+ *  @brief This file defines the interface for reusable barriers.
+ *
+ *  A barrier holds every thread that reaches it until all n of
+ *  them have, then lets them all go at once and is ready for the
+ *  next phase. The last thread to arrive wakes the others with a
+ *  single broadcast.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+struct tcb;
+
+/** @brief What barrier_wait() returns to exactly one thread per phase */
+#define BARRIER_SERIAL_THREAD 1
+
+typedef struct barrier {
+  /* Threads per phase */
+  int n;
+  /* Threads yet to arrive in this phase */
+  volatile int count;
+  /* Flipped by the last arrival of every phase */
+  volatile int sense;
+  /* Spinlock word protecting the waiters */
+  volatile int guard;
+  /* Threads parked in this phase, linked through their TCBs */
+  struct tcb *waiters;
+} barrier_t;
+
+int barrier_init(barrier_t *b, int n);
+
+int barrier_wait(barrier_t *b);
+
+void barrier_destroy(barrier_t *b);
+
+#endif /* BARRIER_H */
@@ -5,9 +5,17 @@
 #ifndef _COND_TYPE_H
 #define _COND_TYPE_H
 
+struct tcb;
+struct mutex;
 
 typedef struct cond {
-  /* fill this in */
+  /* Spinlock word protecting the rest */
+  volatile int guard;
+  /* FIFO of parked waiters, linked through their TCBs */
+  struct tcb *head;
+  struct tcb *tail;
+  /* Mutex the waiters dropped, and get back on wakeup */
+  struct mutex *mutex;
 } cond_t;
 
 #endif /* _COND_TYPE_H */
@@ -0,0 +1,32 @@
+/** @file coroutine.h
+ *  @brief This file defines the interface for coroutines.
+ *
+ *  A coroutine runs on a small stack of its own inside the thread
+ *  that resumes it, until it yields a value back or returns. Any
+ *  thread may resume a suspended coroutine, one at a time.
+ *
+ *  Used as a generator:
+ *
+ *      while(v = coro_resume(g, NULL), !coro_done(g))
+ *          consume(v);
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+typedef struct coro coro_t;
+
+coro_t *coro_create(void *(*func)(coro_t *co, void *arg), void *arg,
+                    unsigned int stack_size);
+
+void *coro_resume(coro_t *co, void *value);
+
+void *coro_yield(coro_t *co, void *value);
+
+int coro_done(coro_t *co);
+
+int coro_destroy(coro_t *co);
+
+#endif /* COROUTINE_H */
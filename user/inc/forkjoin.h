@@ -0,0 +1,40 @@
+/** @file forkjoin.h
+ *  @brief This file defines the interface for the fork-join runtime.
+ *
+ *  fj_spawn() and fj_sync() are plain function calls that queue
+ *  and collect a task on the calling worker; the caller owns the
+ *  task, usually as a local variable, so spawning allocates
+ *  nothing. Every spawned task must be synced before the frame
+ *  holding it returns.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef FORKJOIN_H
+#define FORKJOIN_H
+
+/** @brief A task spawned on the fork-join runtime */
+typedef struct fj_task {
+  /** @brief function to run and its argument */
+  void *(*func)(void *);
+  void *arg;
+  /** @brief what func returned, valid once done is set */
+  void *result;
+  volatile int done;
+  /** @brief thread blocked in fj_run() on this task, if any */
+  void *waiter;
+  /** @brief next task submitted by fj_run() */
+  struct fj_task *next;
+} fj_task_t;
+
+int fj_init(int nworkers);
+
+void *fj_run(void *(*func)(void *), void *arg);
+
+void fj_spawn(fj_task_t *task, void *(*func)(void *), void *arg);
+
+void *fj_sync(fj_task_t *task);
+
+int fj_shutdown(void);
+
+#endif /* FORKJOIN_H */
@@ -0,0 +1,38 @@
+/** @file future.h
+ *  @brief This file defines the interface for futures and promises.
+ *
+ *  A future holds a value that becomes available once, either
+ *  when future_set() is called on it or when the task that
+ *  computes it finishes. Continuations attached with future_then()
+ *  run on a thread pool as soon as the value arrives, so a chain of
+ *  dependent computations keeps no thread blocked while it waits.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include <thrpool.h>
+
+typedef struct future future_t;
+
+future_t *future_create(void);
+
+int future_set(future_t *f, void *value);
+
+future_t *future_async(thrpool_t *pool, void *(*func)(void *), void *arg);
+
+future_t *future_then(future_t *f, thrpool_t *pool, void *(*func)(void *));
+
+int future_ready(future_t *f);
+
+void *future_get(future_t *f);
+
+int future_wait_all(future_t **fs, int n);
+
+int future_wait_any(future_t **fs, int n);
+
+int future_destroy(future_t *f);
+
+#endif /* FUTURE_H */
@@ -0,0 +1,61 @@
+/** @file green.h
+ *  @brief This file defines the interface for user-level threads.
+ *
+ *  Green threads are multiplexed onto a few kernel threads, the
+ *  carriers, and switch between each other without entering the
+ *  kernel. Scheduling is cooperative: a green thread runs until it
+ *  returns, yields, or blocks on a green_mutex_t or green_cond_t.
+ *  A system call that blocks, including the thread library's own
+ *  mutexes and thr_join(), holds up its whole carrier.
+ *
+ *  Inside a green thread, thr_getid() names the carrier it
+ *  currently runs on, and thr_exit() must not be called.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef GREEN_H
+#define GREEN_H
+
+typedef struct green green_t;
+
+/** @brief Mutex that blocks green threads in user space
+ *
+ *  guard is a spinlock word protecting the rest.
+ */
+typedef struct green_mutex {
+  volatile int guard;
+  int locked;
+  green_t *head;
+  green_t *tail;
+} green_mutex_t;
+
+/** @brief Condition variable for green threads */
+typedef struct green_cond {
+  volatile int guard;
+  green_t *head;
+  green_t *tail;
+} green_cond_t;
+
+int green_init(int ncarriers);
+
+green_t *green_create(void *(*func)(void *), void *arg);
+
+int green_join(green_t *g, void **statusp);
+
+void green_yield(void);
+
+void green_exit(void *status);
+
+int green_shutdown(void);
+
+int green_mutex_init(green_mutex_t *mp);
+void green_mutex_lock(green_mutex_t *mp);
+void green_mutex_unlock(green_mutex_t *mp);
+
+int green_cond_init(green_cond_t *cv);
+void green_cond_wait(green_cond_t *cv, green_mutex_t *mp);
+void green_cond_signal(green_cond_t *cv);
+void green_cond_broadcast(green_cond_t *cv);
+
+#endif /* GREEN_H */
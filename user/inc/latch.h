@@ -0,0 +1,35 @@
+/** @file latch.h
+ *  @brief This file defines the interface for countdown latches.
+ *
+ *  A latch starts at a count and opens for good once it has been
+ *  counted down to zero. Threads waiting on it are woken together
+ *  by the count down that opens it.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef LATCH_H
+#define LATCH_H
+
+struct tcb;
+
+typedef struct latch {
+  /* Count downs still to come */
+  volatile int count;
+  /* Spinlock word protecting the waiters */
+  volatile int guard;
+  /* Parked waiters, linked through their TCBs */
+  struct tcb *waiters;
+} latch_t;
+
+int latch_init(latch_t *l, int count);
+
+void latch_count_down(latch_t *l);
+
+void latch_wait(latch_t *l);
+
+int latch_try_wait(latch_t *l);
+
+void latch_destroy(latch_t *l);
+
+#endif /* LATCH_H */
@@ -5,9 +5,34 @@
 #ifndef _MUTEX_TYPE_H
 #define _MUTEX_TYPE_H
 
+struct tcb;
+
+/** @brief Queue node of a thread waiting for an MCS mutex */
+typedef struct mcs_node {
+  struct mcs_node * volatile next;
+  struct tcb *thread;
+  volatile int granted;
+} mcs_node_t;
 
 typedef struct mutex {
-  /* fill this in */
+  /* 0 free, 1 held, 2 held with waiters queued */
+  volatile int state;
+  /* Spinlock word protecting the wait queue */
+  volatile int guard;
+  struct tcb *owner;
+  /* Kernel id of the owner, for waiters to yield to */
+  volatile int owner_kid;
+  /* FIFO of parked waiters, linked through their TCBs */
+  struct tcb *head;
+  struct tcb *tail;
+  /* MCS variant: the queue's tail, and the lock standing in as
+   * the holder's node, see mutex_init_mcs() */
+  int mcs;
+  mcs_node_t * volatile mcs_tail;
+  mcs_node_t mcs_head;
 } mutex_t;
 
+/** @brief Initializes a mutex as an MCS queue lock */
+int mutex_init_mcs( mutex_t *mp );
+
 #endif /* _MUTEX_TYPE_H */
@@ -0,0 +1,37 @@
+/** @file parallel.h
+ *  @brief This file defines the interface for data-parallel loops.
+ *
+ *  parallel_for() splits [begin, end) into chunks and runs body on
+ *  them on a thread pool, the caller taking part as well.
+ *  parallel_reduce() also folds what body returns for each chunk
+ *  with combine, which must be associative; under PAR_DYNAMIC and
+ *  PAR_GUIDED it must be commutative too.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thrpool.h>
+
+/** @brief Scheduling policies
+ *
+ *  PAR_STATIC hands every thread one contiguous share up front.
+ *  PAR_DYNAMIC has threads grab grain-sized chunks from a shared
+ *  counter. PAR_GUIDED grabs large chunks first and shrinks them
+ *  down to grain as the range runs out.
+ */
+#define PAR_STATIC 0
+#define PAR_DYNAMIC 1
+#define PAR_GUIDED 2
+
+int parallel_for(thrpool_t *pool, int begin, int end, int grain, int sched,
+                 void (*body)(int lo, int hi, void *arg), void *arg);
+
+int parallel_reduce(thrpool_t *pool, int begin, int end, int grain, int sched,
+                    void *(*body)(int lo, int hi, void *arg),
+                    void *(*combine)(void *a, void *b),
+                    void *identity, void *arg, void **resultp);
+
+#endif /* PARALLEL_H */
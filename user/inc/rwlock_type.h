@@ -5,9 +5,47 @@
 #ifndef _RWLOCK_TYPE_H
 #define _RWLOCK_TYPE_H
 
+struct tcb;
+
+/** @brief Number of reader counters, a power of two */
+#define RWLOCK_SHARDS 8
+
+/** @brief Policies for rwlock_init_policy(), rwlock_init() prefers writers */
+#define RWLOCK_PREFER_WRITERS 0
+#define RWLOCK_PREFER_READERS 1
+#define RWLOCK_PHASE_FAIR 2
+
+/** @brief One reader counter, on a cache line of its own
+ *
+ *  The alignment also pushes the first counter off the line
+ *  holding the rest of the lock. A lock from malloc() only gets
+ *  malloc()'s alignment, so put it inside a suitably aligned
+ *  block if the counters must not share lines.
+ */
+typedef struct rwlock_shard {
+  volatile int readers;
+} __attribute__((aligned(64))) rwlock_shard_t;
 
 typedef struct rwlock {
-  /* fill this in */
+  /* Nonzero from the moment a writer claims the lock until it leaves */
+  volatile int writer;
+  /* Spinlock word protecting the rest */
+  volatile int guard;
+  struct tcb *owner;
+  /* One of the RWLOCK_ policies above */
+  int policy;
+  /* Writers waiting for the readers to drain */
+  struct tcb * volatile drainer;
+  /* Parked readers and writers, linked through their TCBs */
+  struct tcb *rhead;
+  struct tcb *rtail;
+  struct tcb *whead;
+  struct tcb *wtail;
+  /* Readers inside, spread over counters by thread */
+  rwlock_shard_t shard[RWLOCK_SHARDS];
 } rwlock_t;
 
+/** @brief Initializes a reader/writer lock with the given policy */
+int rwlock_init_policy( rwlock_t *rwlock, int policy );
+
 #endif /* _RWLOCK_TYPE_H */
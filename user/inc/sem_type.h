@@ -5,9 +5,18 @@
 #ifndef _SEM_TYPE_H
 #define _SEM_TYPE_H
 
+struct tcb;
 
 typedef struct sem {
-  /* fill this in */
+  /* Units available, or minus the number of threads waiting */
+  volatile int count;
+  /* Spinlock word protecting the rest */
+  volatile int guard;
+  /* Signals that found their waiter not queued yet */
+  int wakeups;
+  /* FIFO of parked waiters, linked through their TCBs */
+  struct tcb *head;
+  struct tcb *tail;
 } sem_t;
 
 #endif /* _SEM_TYPE_H */
@@ -0,0 +1,31 @@
+/** @file thread_ext.h
+ *  @brief This file defines the thread library's interface beyond
+ *         what thread.h declares.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef THREAD_EXT_H
+#define THREAD_EXT_H
+
+/** @brief Counters for the thread stack cache */
+typedef struct thr_stack_cache_stats {
+  unsigned int hits;      /* thr_create() calls served from the cache */
+  unsigned int misses;    /* thr_create() calls that mapped a new stack */
+  unsigned int evictions; /* released stacks unmapped because it was full */
+  unsigned int cached;    /* stacks currently held */
+} thr_stack_cache_stats_t;
+
+void thr_stack_cache_limit(unsigned int limit);
+
+void thr_stack_cache_stats(thr_stack_cache_stats_t *stats);
+
+void thr_stack_lazy(int enable);
+
+int thr_create_detached(void *(*func)(void *), void *args);
+
+int thr_detach(int tid);
+
+int thr_create_n(void *(*func)(void *), void **args, int n, int *tids);
+
+#endif /* THREAD_EXT_H */
@@ -0,0 +1,26 @@
+/** @file thrpool.h
+ *  @brief This file defines the interface for the thread pool.
+ *
+ *  A pool runs submitted tasks on a fixed set of worker threads,
+ *  so a short task costs a queue push rather than a whole
+ *  thr_create()/thr_join() round trip.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef THRPOOL_H
+#define THRPOOL_H
+
+typedef struct thrpool thrpool_t;
+
+thrpool_t *thrpool_create(int nworkers, int qsize);
+
+int thrpool_submit(thrpool_t *pool, void *(*func)(void *), void *arg);
+
+int thrpool_wait(thrpool_t *pool);
+
+int thrpool_size(thrpool_t *pool);
+
+int thrpool_destroy(thrpool_t *pool);
+
+#endif /* THRPOOL_H */
@@ -0,0 +1,26 @@
+/** @file tls.h
+ *  @brief This file defines the interface for thread-local storage.
+ *
+ *  A key names one slot in every thread. Slots live in the thread's
+ *  TCB, so reading or writing one costs a few instructions and no
+ *  system call. Green threads and coroutines share the slots of the
+ *  kernel thread running them.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#ifndef TLS_H
+#define TLS_H
+
+/** @brief Number of keys a program can create */
+#define TLS_KEYS 32
+
+typedef int tls_key_t;
+
+int key_create(tls_key_t *key, void (*destructor)(void *));
+
+void *tls_get(tls_key_t key);
+
+int tls_set(tls_key_t key, void *value);
+
+#endif /* TLS_H */
@@ -3,14 +3,87 @@
  * instead.
  */
 
+/** @file autostack.c
+ *
+ *  @brief Stacks that are committed on demand
+ *
+ *  An autostack_t describes a stack whose pages are mapped only
+ *  as it grows. A swexn() handler catches the page fault taken
+ *  when the stack runs off its lowest mapped page, maps pages one
+ *  at a time down to the faulting address and resumes the thread.
+ *  Faults outside the stack's reserved range are not ours: the
+ *  handler steps aside and lets the thread die as it would have.
+ *
+ *  The root thread gets one at startup, growing into the space
+ *  left below it by ROOT_STACK_RESERVE; the thread library hands
+ *  one to every lazily committed thread stack.
+ *
+ *  @bug The kernel does not fault on our behalf when a system
+ *       call is passed a buffer in uncommitted stack, so such a
+ *       call fails instead of growing the stack.
+ */
+
 #include<thr_internals.h>
+#include<syscall.h>
+#include<stddef.h>
 
 void * stack_high_ptr;
 void * stack_low_ptr;
 
+/** @brief Stack the root thread's fault handler runs on */
+static char root_exn_stack[AUTOSTACK_EXN_SIZE];
+
+/** @brief Growth state of the root thread's stack */
+static autostack_t root_stack;
+
+static void autostack_fault(void *arg, ureg_t *ureg)
+{
+	autostack_t *as = (autostack_t *)arg;
+	unsigned int page;
+
+	if(ureg->cause == SWEXN_CAUSE_PAGEFAULT &&
+	   ureg->cr2 < as->low && ureg->cr2 >= as->limit)
+	{
+		page = ureg->cr2 & ~(PAGE_SIZE - 1);
+		while(as->low > page)
+		{
+			if(new_pages((void *)(as->low - PAGE_SIZE), PAGE_SIZE) < 0)
+				break;
+			as->low -= PAGE_SIZE;
+		}
+
+		/* Re-arm and retry the faulting instruction */
+		if(as->low <= page)
+			swexn(as->exn_stack, autostack_fault, as, ureg);
+	}
+
+	/* Not a fault we can fix: retry without a handler */
+	swexn(NULL, NULL, NULL, ureg);
+}
+
+/** @brief Registers a fault handler that grows as on demand
+ *
+ *  Handlers are per thread, so this must be called by the thread
+ *  running on the stack.
+ *
+ *  @return 0 on success, negative if the kernel refused
+ */
+int autostack_attach(autostack_t *as)
+{
+	return swexn(as->exn_stack, autostack_fault, as, NULL);
+}
+
 void
 install_autostack(void *stack_high, void *stack_low)
 {
 	stack_high_ptr = stack_high;
 	stack_low_ptr = stack_low;
+
+	root_stack.low = (unsigned int)stack_low;
+	if(root_stack.low > ROOT_STACK_RESERVE)
+		root_stack.limit = root_stack.low - ROOT_STACK_RESERVE;
+	else
+		root_stack.limit = PAGE_SIZE;
+	root_stack.exn_stack = root_exn_stack + AUTOSTACK_EXN_SIZE;
+	autostack_attach(&root_stack);
 }
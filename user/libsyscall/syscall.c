@@ -79,10 +79,10 @@ int sleep(int ticks)
 	return -1;
 }*/
 
-int swexn(void *esp3, swexn_handler_t eip, void *arg, ureg_t *newureg)
+/*int swexn(void *esp3, swexn_handler_t eip, void *arg, ureg_t *newureg)
 {
 	return -1;
-}
+}*/
 
 /*char getchar(void)
 {
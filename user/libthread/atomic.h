@@ -0,0 +1,32 @@
+/** @file atomic.h
+ *
+ *  @brief Atomic operations and spinlocks used inside
+ *         the thread library.
+ */
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+/** @brief Atomically store val in *addr, returns the old value */
+int atomic_xchg(volatile int *addr, int val);
+
+/** @brief Store val in *addr if it holds expect, returns the old value */
+int atomic_cmpxchg(volatile int *addr, int expect, int val);
+
+/** @brief Atomically add delta to *addr, returns the old value */
+int atomic_xadd(volatile int *addr, int delta);
+
+/** @brief Spinlock used for short internal critical sections */
+typedef struct spinlock {
+  volatile int held;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+void spin_init(spinlock_t *lock);
+
+void spin_lock(spinlock_t *lock);
+
+void spin_unlock(spinlock_t *lock);
+
+#endif /* ATOMIC_H */
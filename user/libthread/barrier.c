@@ -0,0 +1,104 @@
+/** @file barrier.c
+ *
+ *  @brief Sense-reversing barriers
+ *
+ *  Arriving is one xadd on the count. Every thread notes the sense
+ *  before it arrives; the last one to arrive resets the count for
+ *  the next phase and then flips the sense, which is what lets the
+ *  others go. Since the count is reset first, a thread racing ahead
+ *  into the next phase can arrive again before the slow ones have
+ *  even noticed the flip.
+ *
+ *  Waiters spin on the sense for a little while and then park on
+ *  the barrier. The flip and the taking of the parked list happen
+ *  under the guard, so a waiter either sees the flip there or is on
+ *  the list, and the whole list is woken in one sweep.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <barrier.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief Looks at the sense before parking */
+#define BARRIER_SPINS 64
+
+/** @brief The guard word of a barrier, as a spinlock */
+#define GUARD(b) ((spinlock_t *)&(b) -> guard)
+
+int barrier_init(barrier_t *b, int n)
+{
+	if(b == NULL || n <= 0)
+		return ERROR;
+
+	b -> n = n;
+	b -> count = n;
+	b -> sense = 0;
+	b -> guard = 0;
+	b -> waiters = NULL;
+	return SUCCESS;
+}
+
+/** @brief Waits until all n threads have reached b
+ *
+ *  @return BARRIER_SERIAL_THREAD to the last thread to arrive, 0 to
+ *          the rest
+ */
+int barrier_wait(barrier_t *b)
+{
+	int sense = b -> sense;
+	tcb self, waiters, next;
+	int i;
+
+	if(atomic_xadd(&b -> count, -1) == 1)
+	{
+		b -> count = b -> n;
+
+		spin_lock(GUARD(b));
+		b -> sense = !sense;
+		waiters = b -> waiters;
+		b -> waiters = NULL;
+		spin_unlock(GUARD(b));
+
+		for(; waiters != NULL; waiters = next)
+		{
+			next = waiters -> wait_next;
+			thr_unpark(waiters);
+		}
+		return BARRIER_SERIAL_THREAD;
+	}
+
+	for(i = 0; i < BARRIER_SPINS; i++)
+	{
+		if(b -> sense != sense)
+			return 0;
+	}
+
+	self = thr_self();
+
+	spin_lock(GUARD(b));
+	if(b -> sense != sense)
+	{
+		spin_unlock(GUARD(b));
+		return 0;
+	}
+	thr_park_prepare(self);
+	self -> wait_next = b -> waiters;
+	b -> waiters = self;
+	spin_unlock(GUARD(b));
+
+	thr_park(self);
+	return 0;
+}
+
+void barrier_destroy(barrier_t *b)
+{
+	if(b -> count != b -> n || b -> waiters != NULL)
+		panic("barrier_destroy: barrier %p has waiters", b);
+}
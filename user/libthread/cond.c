@@ -0,0 +1,135 @@
+/** @file cond.c
+ *
+ *  @brief Condition variables with wait morphing
+ *
+ *  A waiter queues itself on the condition, drops the mutex and
+ *  parks. Signalling does not wake it: the waiter is moved onto the
+ *  mutex's own wait queue and is woken by the mutex_unlock() that
+ *  hands it the mutex, so it wakes up holding the lock it has to
+ *  retake anyway. A broadcast moves the whole queue over under one
+ *  acquisition of the mutex's guard, and the waiters then run one
+ *  at a time as the mutex is passed along, rather than all waking
+ *  at once just to fight over it.
+ *
+ *  Waiters on an MCS mutex cannot be queued on their behalf, since
+ *  their queue nodes live on their own stacks; those are woken and
+ *  take the mutex themselves.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <cond.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief The guard word of a condition, as a spinlock */
+#define GUARD(cv) ((spinlock_t *)&(cv) -> guard)
+
+int cond_init( cond_t *cv )
+{
+	if(cv == NULL)
+		return ERROR;
+
+	cv -> guard = 0;
+	cv -> head = NULL;
+	cv -> tail = NULL;
+	cv -> mutex = NULL;
+	return SUCCESS;
+}
+
+void cond_destroy( cond_t *cv )
+{
+	if(cv -> head != NULL)
+		panic("cond_destroy: condition %p has waiters", cv);
+}
+
+/** @brief Waits on cv, with mp held on entry and on return
+ *
+ *  We are on the queue before mp is dropped, so a signal sent once
+ *  it is dropped cannot be missed. A waiter moved onto the mutex
+ *  queue is made its owner before being woken; one that was not
+ *  takes it back itself.
+ */
+void cond_wait( cond_t *cv, mutex_t *mp )
+{
+	tcb self = thr_self();
+
+	spin_lock(GUARD(cv));
+	thr_park_prepare(self);
+	self -> wait_next = NULL;
+	if(cv -> tail != NULL)
+		cv -> tail -> wait_next = self;
+	else
+		cv -> head = self;
+	cv -> tail = self;
+	cv -> mutex = mp;
+	spin_unlock(GUARD(cv));
+
+	mutex_unlock(mp);
+	thr_park(self);
+
+	if(mp -> owner != self)
+		mutex_lock(mp);
+}
+
+/** @brief Hands woken waiters over to the mutex they wait with */
+static void cond_release(mutex_t *mp, tcb first, tcb last)
+{
+	tcb next;
+
+	if(!mp -> mcs)
+	{
+		first = mutex_requeue(mp, first, last);
+		if(first != NULL)
+			thr_unpark(first);
+		return;
+	}
+
+	for(; first != NULL; first = next)
+	{
+		next = first == last ? NULL : first -> wait_next;
+		thr_unpark(first);
+	}
+}
+
+void cond_signal( cond_t *cv )
+{
+	tcb waiter;
+	mutex_t *mp;
+
+	spin_lock(GUARD(cv));
+	waiter = cv -> head;
+	if(waiter != NULL)
+	{
+		cv -> head = waiter -> wait_next;
+		if(cv -> head == NULL)
+			cv -> tail = NULL;
+	}
+	mp = cv -> mutex;
+	spin_unlock(GUARD(cv));
+
+	if(waiter != NULL)
+		cond_release(mp, waiter, waiter);
+}
+
+void cond_broadcast( cond_t *cv )
+{
+	tcb first, last;
+	mutex_t *mp;
+
+	spin_lock(GUARD(cv));
+	first = cv -> head;
+	last = cv -> tail;
+	cv -> head = NULL;
+	cv -> tail = NULL;
+	mp = cv -> mutex;
+	spin_unlock(GUARD(cv));
+
+	if(first != NULL)
+		cond_release(mp, first, last);
+}
@@ -0,0 +1,151 @@
+/** @file coroutine.c
+ *
+ *  @brief Coroutines and generators
+ *
+ *  A coroutine is a saved stack pointer on a stack block from
+ *  thr_stack.c with only a few pages committed. Resuming and
+ *  yielding are a ctx_switch() each way, with no system call and
+ *  no scheduler involved. The coroutine record itself sits at the
+ *  top of its own stack, so creating one allocates nothing but the
+ *  stack, and the coroutine finds its record from any address on
+ *  that stack.
+ *
+ *  Whoever resumes a coroutine becomes the owner of its block, so
+ *  thr_self() and everything built on it keep working inside.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug A coroutine that overflows its stack faults on the
+ *       unmapped part of its block, and no handler grows it.
+ */
+
+#include <thr_internals.h>
+#include <coroutine.h>
+#include <stddef.h>
+#include "thr_private.h"
+
+/** @brief Stack size used when the caller does not pick one */
+#define CORO_STACK_DEFAULT 8192
+
+#define CORO_SUSPENDED 0
+#define CORO_RUNNING 1
+#define CORO_DONE 2
+
+struct coro {
+  /* Saved contexts of the coroutine and of its resumer */
+  void *sp;
+  void *caller_sp;
+  stack_block *block;
+  void *(*func)(coro_t *, void *);
+  void *arg;
+
+  /* Value handed across the last switch */
+  void *transfer;
+  int state;
+};
+
+/** @brief Record of the coroutine whose stack we are on */
+static coro_t *coro_self(void)
+{
+	int here;
+
+	return (coro_t *)BLOCK_STACK_TOP(BLOCK_FROM_SP(&here)) - 1;
+}
+
+/** @brief First code run by a coroutine */
+static void coro_start(void)
+{
+	coro_t *co = coro_self();
+
+	co -> transfer = co -> func(co, co -> arg);
+	co -> state = CORO_DONE;
+	ctx_switch(&co -> sp, co -> caller_sp);
+}
+
+/** @brief Creates a suspended coroutine running func(co, arg)
+ *
+ *  @param stack_size Bytes of stack, 0 for the default
+ *  @return The coroutine, or NULL
+ */
+coro_t *coro_create(void *(*func)(coro_t *co, void *arg), void *arg,
+                    unsigned int stack_size)
+{
+	stack_block *block;
+	coro_t *co;
+
+	if(func == NULL)
+		return NULL;
+
+	if(stack_size == 0)
+		stack_size = CORO_STACK_DEFAULT;
+
+	block = thr_stack_get_small(stack_size);
+	if(block == NULL)
+		return NULL;
+
+	co = (coro_t *)BLOCK_STACK_TOP(block) - 1;
+	co -> block = block;
+	co -> func = func;
+	co -> arg = arg;
+	co -> transfer = NULL;
+	co -> state = CORO_SUSPENDED;
+	co -> caller_sp = NULL;
+	co -> sp = ctx_init(co, coro_start);
+
+	return co;
+}
+
+/** @brief Runs co until it yields or returns
+ *
+ *  @param value What the pending coro_yield() returns inside co;
+ *         ignored on the first resume
+ *  @return The value yielded or returned by co, or NULL if co is
+ *          running or finished
+ */
+void *coro_resume(coro_t *co, void *value)
+{
+	if(co == NULL || co -> state != CORO_SUSPENDED)
+		return NULL;
+
+	co -> transfer = value;
+	co -> state = CORO_RUNNING;
+	co -> block -> owner = thr_self();
+	ctx_switch(&co -> caller_sp, co -> sp);
+
+	return co -> transfer;
+}
+
+/** @brief Suspends co, from inside it, handing value to its resumer
+ *
+ *  @return The value passed to the coro_resume() that continues us
+ */
+void *coro_yield(coro_t *co, void *value)
+{
+	co -> transfer = value;
+	co -> state = CORO_SUSPENDED;
+	ctx_switch(&co -> sp, co -> caller_sp);
+
+	return co -> transfer;
+}
+
+/** @brief Tells whether co has returned */
+int coro_done(coro_t *co)
+{
+	return co -> state == CORO_DONE;
+}
+
+/** @brief Frees a coroutine that is not running
+ *
+ *  A suspended coroutine is dropped as is; nothing left on its
+ *  stack is unwound.
+ *
+ *  @return 0, or ERROR if co is NULL or running
+ */
+int coro_destroy(coro_t *co)
+{
+	if(co == NULL || co -> state == CORO_RUNNING)
+		return ERROR;
+
+	thr_stack_free(co -> block);
+	return SUCCESS;
+}
@@ -0,0 +1,413 @@
+/** @file forkjoin.c
+ *
+ *  @brief Work-stealing fork-join runtime
+ *
+ *  A handful of worker threads run every task. Each worker owns a
+ *  Chase-Lev deque: it pushes and takes its own spawned tasks at
+ *  the bottom without any lock, while idle workers steal from the
+ *  top of a random victim's deque with a single cmpxchg. A worker
+ *  syncing on a task that is still queued simply takes it back and
+ *  runs it inline, so a recursion tree that is never stolen from
+ *  runs like plain function calls; one that was stolen is helped
+ *  along by stealing other work until the thief finishes it.
+ *
+ *  fj_run() hands a root task to the workers through a short
+ *  locked list and parks the caller until it is done. Workers park
+ *  themselves on an idle list while no fj_run() is in progress.
+ *
+ *  Deques have a fixed capacity; a spawn that finds its deque full
+ *  runs the task on the spot, which is always correct.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <forkjoin.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief Capacity of each worker's deque, a power of two */
+#define FJ_DEQUE_SIZE 4096
+
+/** @brief A worker and its deque
+ *
+ *  top is written by thieves and bottom only by the owner, so
+ *  they live on separate cache lines.
+ */
+typedef struct fj_worker {
+  volatile int top;
+  volatile int bottom __attribute__((aligned(CACHE_LINE)));
+  fj_task_t * volatile * buf;
+  unsigned int seed;
+  int tid;
+} __attribute__((aligned(CACHE_LINE))) fj_worker_t;
+
+static fj_worker_t *workers;
+static void *workers_mem;
+static int nworkers;
+
+/** @brief Protects everything below */
+static spinlock_t fj_lock = SPINLOCK_INIT;
+
+/** @brief Root tasks waiting for a worker */
+static fj_task_t * volatile fj_inject;
+
+/** @brief Number of fj_run() calls in progress */
+static int fj_running;
+static int fj_stopping;
+
+/** @brief Workers parked while nothing is running */
+static tcb fj_idle;
+
+/** @brief Queues a task at the bottom of our own deque
+ *
+ *  @return SUCCESS, or ERROR if the deque is full
+ */
+static int deque_push(fj_worker_t *w, fj_task_t *task)
+{
+	int b = w -> bottom;
+
+	if(b - w -> top >= FJ_DEQUE_SIZE)
+		return ERROR;
+
+	w -> buf[b & (FJ_DEQUE_SIZE - 1)] = task;
+	w -> bottom = b + 1;
+	return SUCCESS;
+}
+
+/** @brief Takes the most recently pushed task off our own deque
+ *
+ *  The xchg on bottom is a full fence, so a thief either sees the
+ *  slot gone or we see its claim on top; when one task is left the
+ *  two settle it with a cmpxchg on top.
+ */
+static fj_task_t *deque_take(fj_worker_t *w)
+{
+	int b = w -> bottom - 1;
+	int t;
+	fj_task_t *task;
+
+	atomic_xchg(&w -> bottom, b);
+	t = w -> top;
+
+	if(t > b)
+	{
+		w -> bottom = b + 1;
+		return NULL;
+	}
+
+	task = w -> buf[b & (FJ_DEQUE_SIZE - 1)];
+	if(t == b)
+	{
+		if(atomic_cmpxchg(&w -> top, t, t + 1) != t)
+			task = NULL;
+		w -> bottom = b + 1;
+	}
+
+	return task;
+}
+
+/** @brief Steals the oldest task off somebody else's deque */
+static fj_task_t *deque_steal(fj_worker_t *w)
+{
+	int t = w -> top;
+	int b = w -> bottom;
+	fj_task_t *task;
+
+	if(t >= b)
+		return NULL;
+
+	task = w -> buf[t & (FJ_DEQUE_SIZE - 1)];
+	if(atomic_cmpxchg(&w -> top, t, t + 1) != t)
+		return NULL;
+
+	return task;
+}
+
+/** @brief Runs a task and wakes whoever waits on it in fj_run() */
+static void fj_execute(fj_task_t *task)
+{
+	tcb waiter;
+
+	task -> result = task -> func(task -> arg);
+
+	/* The task may be gone as soon as done is set */
+	waiter = task -> waiter;
+	task -> done = 1;
+	if(waiter != NULL)
+		thr_unpark(waiter);
+}
+
+/** @brief Finds a task for an idle worker
+ *
+ *  Root tasks come first, then one sweep over the other workers
+ *  starting from a random victim.
+ */
+static fj_task_t *fj_find_work(fj_worker_t *w)
+{
+	fj_task_t *task = NULL;
+	int i, victim;
+
+	if(fj_inject != NULL)
+	{
+		spin_lock(&fj_lock);
+		task = fj_inject;
+		if(task != NULL)
+			fj_inject = task -> next;
+		spin_unlock(&fj_lock);
+		if(task != NULL)
+			return task;
+	}
+
+	/* xorshift, good enough to spread thieves around */
+	w -> seed ^= w -> seed << 13;
+	w -> seed ^= w -> seed >> 17;
+	w -> seed ^= w -> seed << 5;
+	victim = w -> seed % nworkers;
+
+	for(i = 0; i < nworkers && task == NULL; i++)
+	{
+		if(&workers[victim] != w)
+			task = deque_steal(&workers[victim]);
+		victim = (victim + 1) % nworkers;
+	}
+
+	return task;
+}
+
+/** @brief Body of every worker thread */
+static void *fj_worker_main(void *arg)
+{
+	fj_worker_t *w = arg;
+	tcb self = thr_self();
+	fj_task_t *task;
+
+	self -> fj_worker = w;
+
+	for(;;)
+	{
+		spin_lock(&fj_lock);
+		while(fj_running == 0 && !fj_stopping)
+		{
+			thr_park_prepare(self);
+			self -> wait_next = fj_idle;
+			fj_idle = self;
+			spin_unlock(&fj_lock);
+			thr_park(self);
+			spin_lock(&fj_lock);
+		}
+		if(fj_running == 0)
+		{
+			spin_unlock(&fj_lock);
+			break;
+		}
+		spin_unlock(&fj_lock);
+
+		task = fj_find_work(w);
+		if(task != NULL)
+			fj_execute(task);
+		else
+			yield(-1);
+	}
+
+	return NULL;
+}
+
+/** @brief Starts the fork-join workers
+ *
+ *  @param n Number of worker threads
+ *  @return 0, or ERROR if the workers could not be started
+ *
+ *  @pre thr_init should have been called
+ */
+int fj_init(int n)
+{
+	void **args;
+	int *tids;
+	int i, created;
+
+	if(n <= 0 || workers != NULL)
+		return ERROR;
+
+	workers_mem = calloc(1, n * sizeof(fj_worker_t) + CACHE_LINE);
+	args = malloc(n * sizeof(void *));
+	tids = malloc(n * sizeof(int));
+	if(workers_mem == NULL || args == NULL || tids == NULL)
+	{
+		free(tids);
+		free(args);
+		free(workers_mem);
+		workers_mem = NULL;
+		return ERROR;
+	}
+
+	workers = (fj_worker_t *)(((unsigned int)workers_mem + CACHE_LINE - 1) &
+	                          ~(CACHE_LINE - 1));
+	for(i = 0; i < n; i++)
+	{
+		workers[i].buf = malloc(FJ_DEQUE_SIZE * sizeof(fj_task_t *));
+		workers[i].seed = 2463534242u + i;
+		args[i] = &workers[i];
+		if(workers[i].buf == NULL)
+			break;
+	}
+	nworkers = i;
+
+	if(nworkers == n)
+		created = thr_create_n(fj_worker_main, args, n, tids);
+	else
+		created = 0;
+	if(created < 0)
+		created = 0;
+
+	for(i = 0; i < created; i++)
+		workers[i].tid = tids[i];
+	free(tids);
+	free(args);
+
+	if(created < n)
+	{
+		/* Only the workers that started have to be stopped */
+		for(i = created; i < nworkers; i++)
+			free((void *)workers[i].buf);
+		nworkers = created;
+		fj_shutdown();
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/** @brief Runs func(arg) as the root of a fork-join computation
+ *
+ *  The caller blocks until the root task, and so every task it
+ *  spawned, has finished. Called from inside a task it is just a
+ *  function call.
+ *
+ *  @return What func returned
+ */
+void *fj_run(void *(*func)(void *), void *arg)
+{
+	tcb self = thr_self();
+	fj_task_t root;
+	tcb idle, next;
+
+	if(self -> fj_worker != NULL || workers == NULL)
+		return func(arg);
+
+	root.func = func;
+	root.arg = arg;
+	root.done = 0;
+	root.waiter = self;
+	thr_park_prepare(self);
+
+	spin_lock(&fj_lock);
+	root.next = fj_inject;
+	fj_inject = &root;
+	fj_running++;
+	idle = fj_idle;
+	fj_idle = NULL;
+	spin_unlock(&fj_lock);
+
+	for(; idle != NULL; idle = next)
+	{
+		next = idle -> wait_next;
+		thr_unpark(idle);
+	}
+
+	thr_park(self);
+
+	spin_lock(&fj_lock);
+	fj_running--;
+	spin_unlock(&fj_lock);
+
+	return root.result;
+}
+
+/** @brief Makes func(arg) available to run in parallel with the caller
+ *
+ *  Outside a worker, or with a full deque, the task runs right away.
+ */
+void fj_spawn(fj_task_t *task, void *(*func)(void *), void *arg)
+{
+	fj_worker_t *w = thr_self() -> fj_worker;
+
+	task -> func = func;
+	task -> arg = arg;
+	task -> done = 0;
+	task -> waiter = NULL;
+	task -> next = NULL;
+
+	if(w == NULL || deque_push(w, task) < 0)
+		fj_execute(task);
+}
+
+/** @brief Waits for a spawned task and returns its result
+ *
+ *  While the task is not done we keep running work, our own
+ *  first and then whatever we can steal, rather than block.
+ */
+void *fj_sync(fj_task_t *task)
+{
+	fj_worker_t *w = thr_self() -> fj_worker;
+	fj_task_t *next;
+
+	while(!task -> done)
+	{
+		next = deque_take(w);
+		if(next == NULL)
+			next = fj_find_work(w);
+
+		if(next != NULL)
+			fj_execute(next);
+		else
+			yield(-1);
+	}
+
+	return task -> result;
+}
+
+/** @brief Stops the workers and frees the runtime
+ *
+ *  @return 0, or ERROR if the runtime was not started
+ *
+ *  @pre No fj_run() is in progress
+ */
+int fj_shutdown(void)
+{
+	tcb idle, next;
+	int i;
+
+	if(workers == NULL)
+		return ERROR;
+
+	spin_lock(&fj_lock);
+	fj_stopping = 1;
+	idle = fj_idle;
+	fj_idle = NULL;
+	spin_unlock(&fj_lock);
+
+	for(; idle != NULL; idle = next)
+	{
+		next = idle -> wait_next;
+		thr_unpark(idle);
+	}
+
+	for(i = 0; i < nworkers; i++)
+	{
+		thr_join(workers[i].tid, NULL);
+		free((void *)workers[i].buf);
+	}
+
+	free(workers_mem);
+	workers = NULL;
+	workers_mem = NULL;
+	nworkers = 0;
+	fj_stopping = 0;
+	return SUCCESS;
+}
@@ -0,0 +1,365 @@
+/** @file future.c
+ *
+ *  @brief Futures and promises
+ *
+ *  A future is a value slot, a list of threads waiting for it and
+ *  a list of continuations, all under one spinlock. Setting the
+ *  value takes both lists in one go, wakes the waiters and hands
+ *  each continuation to its pool; nothing waits on a future by
+ *  holding a thread of its own.
+ *
+ *  A waiter puts a node on every future it waits for. All nodes of
+ *  one wait share a claim word, and only whoever flips it first
+ *  wakes the waiter, so a thread waiting on several futures is
+ *  unparked exactly once however many of them complete. Nodes are
+ *  only ever looked at under their future's lock, which is what
+ *  lets the waiter take the others back off and return.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug Continuations are submitted from whichever thread sets the
+ *       value; if that is a worker of a full pool, see thrpool.c.
+ */
+
+#include <thr_internals.h>
+#include <future.h>
+#include <thread.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief A thread waiting for the future it is queued on */
+typedef struct future_waiter {
+  tcb thread;
+  volatile int *claim;
+  struct future_waiter *next;
+} future_waiter_t;
+
+/** @brief A computation to run once its input is ready
+ *
+ *  The same record describes a future_async() task, whose input
+ *  is available up front.
+ */
+typedef struct future_cont {
+  void *(*func)(void *);
+  void *arg;
+  thrpool_t *pool;
+  future_t *result;
+  struct future_cont *next;
+} future_cont_t;
+
+struct future {
+  spinlock_t lock;
+  int ready;
+  void *value;
+  future_waiter_t *waiters;
+  future_cont_t *conts;
+};
+
+/** @brief Pool task computing a continuation's future */
+static void *future_run(void *arg)
+{
+	future_cont_t *cont = arg;
+	future_t *result = cont -> result;
+	void *value = cont -> func(cont -> arg);
+
+	free(cont);
+	future_set(result, value);
+	return NULL;
+}
+
+/** @brief Starts a continuation whose input is ready
+ *
+ *  Without a pool, or if the pool is going away, the continuation
+ *  runs in the calling thread.
+ */
+static void future_start(future_cont_t *cont)
+{
+	if(cont -> pool == NULL ||
+	   thrpool_submit(cont -> pool, future_run, cont) < 0)
+		future_run(cont);
+}
+
+future_t *future_create(void)
+{
+	future_t *f = calloc(1, sizeof(future_t));
+
+	if(f != NULL)
+		spin_init(&f -> lock);
+	return f;
+}
+
+/** @brief Fulfils a future
+ *
+ *  @return 0, or ERROR if f is NULL or already has a value
+ */
+int future_set(future_t *f, void *value)
+{
+	future_waiter_t *w;
+	future_cont_t *cont, *next;
+	tcb wake = NULL;
+	tcb thread;
+
+	if(f == NULL)
+		return ERROR;
+
+	spin_lock(&f -> lock);
+	if(f -> ready)
+	{
+		spin_unlock(&f -> lock);
+		return ERROR;
+	}
+	f -> value = value;
+	f -> ready = 1;
+
+	/* Claim the waiters now, the nodes die once we let go */
+	for(w = f -> waiters; w != NULL; w = w -> next)
+	{
+		if(atomic_xchg(w -> claim, 1) == 0)
+		{
+			w -> thread -> wait_next = wake;
+			wake = w -> thread;
+		}
+	}
+	f -> waiters = NULL;
+	cont = f -> conts;
+	f -> conts = NULL;
+	spin_unlock(&f -> lock);
+
+	for(; wake != NULL; wake = thread)
+	{
+		thread = wake -> wait_next;
+		thr_unpark(wake);
+	}
+
+	for(; cont != NULL; cont = next)
+	{
+		next = cont -> next;
+		cont -> arg = value;
+		future_start(cont);
+	}
+
+	return SUCCESS;
+}
+
+/** @brief Runs func(arg) on pool
+ *
+ *  @return Future of what func returns, or NULL
+ */
+future_t *future_async(thrpool_t *pool, void *(*func)(void *), void *arg)
+{
+	future_t *f;
+	future_cont_t *cont;
+
+	if(func == NULL)
+		return NULL;
+
+	f = future_create();
+	cont = malloc(sizeof(future_cont_t));
+	if(f == NULL || cont == NULL)
+	{
+		free(cont);
+		free(f);
+		return NULL;
+	}
+
+	cont -> func = func;
+	cont -> arg = arg;
+	cont -> pool = pool;
+	cont -> result = f;
+	future_start(cont);
+
+	return f;
+}
+
+/** @brief Runs func on f's value, on pool, once f has one
+ *
+ *  @return Future of what func returns, or NULL
+ */
+future_t *future_then(future_t *f, thrpool_t *pool, void *(*func)(void *))
+{
+	future_t *result;
+	future_cont_t *cont;
+
+	if(f == NULL || func == NULL)
+		return NULL;
+
+	result = future_create();
+	cont = malloc(sizeof(future_cont_t));
+	if(result == NULL || cont == NULL)
+	{
+		free(cont);
+		free(result);
+		return NULL;
+	}
+
+	cont -> func = func;
+	cont -> pool = pool;
+	cont -> result = result;
+
+	spin_lock(&f -> lock);
+	if(!f -> ready)
+	{
+		cont -> next = f -> conts;
+		f -> conts = cont;
+		cont = NULL;
+	}
+	else
+		cont -> arg = f -> value;
+	spin_unlock(&f -> lock);
+
+	if(cont != NULL)
+		future_start(cont);
+
+	return result;
+}
+
+/** @brief Tells whether f has a value yet, without blocking */
+int future_ready(future_t *f)
+{
+	int ready;
+
+	spin_lock(&f -> lock);
+	ready = f -> ready;
+	spin_unlock(&f -> lock);
+
+	return ready;
+}
+
+/** @brief Blocks until one of fs has a value
+ *
+ *  @param nodes One waiter node per future, owned by the caller
+ *  @return Index of a future that has a value
+ */
+static int future_wait(future_t **fs, int n, future_waiter_t *nodes)
+{
+	tcb self = thr_self();
+	volatile int claim = 0;
+	future_waiter_t **link;
+	int i, first = -1;
+
+	thr_park_prepare(self);
+
+	for(i = 0; i < n && first < 0; i++)
+	{
+		spin_lock(&fs[i] -> lock);
+		if(fs[i] -> ready)
+			first = i;
+		else
+		{
+			nodes[i].thread = self;
+			nodes[i].claim = &claim;
+			nodes[i].next = fs[i] -> waiters;
+			fs[i] -> waiters = &nodes[i];
+		}
+		spin_unlock(&fs[i] -> lock);
+	}
+
+	/* Whoever flips the claim owes us exactly one wakeup, so if a
+	 * future completed under us we still have to take it */
+	if(first < 0 || atomic_xchg(&claim, 1) != 0)
+		thr_park(self);
+
+	/* Take back the nodes nobody has taken off yet */
+	n = first < 0 ? n : first;
+	for(i = 0; i < n; i++)
+	{
+		spin_lock(&fs[i] -> lock);
+		link = &fs[i] -> waiters;
+		for(; *link != NULL; link = &(*link) -> next)
+		{
+			if(*link == &nodes[i])
+			{
+				*link = nodes[i].next;
+				break;
+			}
+		}
+		if(first < 0 && fs[i] -> ready)
+			first = i;
+		spin_unlock(&fs[i] -> lock);
+	}
+
+	return first;
+}
+
+/** @brief Waits for f to have a value and returns it
+ *
+ *  @return The value, or NULL if f is NULL
+ */
+void *future_get(future_t *f)
+{
+	future_waiter_t node;
+
+	if(f == NULL)
+		return NULL;
+
+	future_wait(&f, 1, &node);
+	return f -> value;
+}
+
+/** @brief Waits until every one of fs has a value
+ *
+ *  @return 0, or ERROR if an argument is invalid
+ */
+int future_wait_all(future_t **fs, int n)
+{
+	int i;
+
+	if(fs == NULL || n < 0)
+		return ERROR;
+
+	for(i = 0; i < n; i++)
+	{
+		if(fs[i] == NULL)
+			return ERROR;
+	}
+
+	for(i = 0; i < n; i++)
+		future_get(fs[i]);
+
+	return SUCCESS;
+}
+
+/** @brief Waits until at least one of fs has a value
+ *
+ *  @return Index of a future that has a value, or ERROR
+ */
+int future_wait_any(future_t **fs, int n)
+{
+	future_waiter_t *nodes;
+	int i;
+
+	if(fs == NULL || n <= 0)
+		return ERROR;
+
+	for(i = 0; i < n; i++)
+	{
+		if(fs[i] == NULL)
+			return ERROR;
+		if(future_ready(fs[i]))
+			return i;
+	}
+
+	nodes = malloc(n * sizeof(future_waiter_t));
+	if(nodes == NULL)
+		return ERROR;
+
+	i = future_wait(fs, n, nodes);
+	free(nodes);
+	return i;
+}
+
+/** @brief Frees a future
+ *
+ *  @return 0, or ERROR if f is NULL or still has no value
+ *
+ *  @pre Nobody waits on f or attaches to it any more
+ */
+int future_destroy(future_t *f)
+{
+	if(f == NULL || !future_ready(f))
+		return ERROR;
+
+	free(f);
+	return SUCCESS;
+}
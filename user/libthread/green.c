@@ -0,0 +1,548 @@
+/** @file green.c
+ *
+ *  @brief User-level (M:N) threads
+ *
+ *  Green threads run on ordinary stack blocks from thr_stack.c,
+ *  fully committed since a carrier's fault handler only knows the
+ *  carrier's own stack. Whenever a carrier switches onto a green
+ *  thread it makes itself the owner of that block, so thr_self()
+ *  on a green stack finds the carrier's TCB and everything the
+ *  library keys off it (parking, the kernel id) keeps working.
+ *
+ *  Each carrier runs a scheduler loop on its own stack. A green
+ *  thread gives the CPU back by switching to that loop and leaving
+ *  a note of what should happen to it: requeue it (yield), leave
+ *  it alone (it blocked) or reclaim its stack (it exited). A
+ *  blocking green thread also leaves the spinlock guarding the
+ *  wait queue it put itself on; the carrier drops it only after the
+ *  switch, so nobody can resume the thread while it is still
+ *  running on its stack.
+ *
+ *  Ready threads wait on one FIFO run queue. Carriers that find it
+ *  empty park until green_ready() hands them something to do.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No preemption: a green thread that never yields or blocks
+ *       keeps its carrier forever.
+ */
+
+#include <thr_internals.h>
+#include <green.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief What the carrier does with the thread that just left */
+#define GREEN_YIELD 0
+#define GREEN_BLOCK 1
+#define GREEN_EXIT 2
+
+/** @brief The guard word of a mutex or condition, as a spinlock */
+#define GUARD(x) ((spinlock_t *)&(x) -> guard)
+
+struct green {
+  /* Saved stack pointer while switched out */
+  void *sp;
+  stack_block *block;
+  void *(*func)(void *);
+  void *arg;
+  void *result;
+
+  /* Protects done and the joiners */
+  spinlock_t lock;
+  int done;
+  green_t *joiner;
+  tcb kjoiner;
+
+  /* Run queue or wait queue link */
+  green_t *next;
+};
+
+/** @brief A kernel thread running green threads */
+typedef struct green_carrier {
+  /* Scheduler context while a green thread runs */
+  void *sp;
+  green_t *current;
+  int action;
+  spinlock_t *release;
+  int tid;
+} green_carrier_t;
+
+static green_carrier_t *carriers;
+static int ncarriers;
+
+/** @brief Protects everything below */
+static spinlock_t green_lock = SPINLOCK_INIT;
+
+static green_t *run_head;
+static green_t *run_tail;
+
+/** @brief Carriers parked on an empty run queue */
+static tcb idle_carriers;
+static int green_stopping;
+
+/** @brief Carrier of the calling thread, NULL outside any */
+static green_carrier_t *green_carrier(void)
+{
+	return thr_self() -> green_carrier;
+}
+
+/** @brief Puts a thread on the run queue and finds it a carrier */
+static void green_ready(green_t *g)
+{
+	tcb carrier;
+
+	g -> next = NULL;
+
+	spin_lock(&green_lock);
+	if(run_tail != NULL)
+		run_tail -> next = g;
+	else
+		run_head = g;
+	run_tail = g;
+
+	carrier = idle_carriers;
+	if(carrier != NULL)
+		idle_carriers = carrier -> wait_next;
+	spin_unlock(&green_lock);
+
+	if(carrier != NULL)
+		thr_unpark(carrier);
+}
+
+/** @brief Switches from the calling green thread back to its carrier
+ *
+ *  @param action What the carrier should do with us
+ *  @param release Spinlock the carrier drops once we are off our
+ *         stack, or NULL
+ */
+static void green_switch(int action, spinlock_t *release)
+{
+	green_carrier_t *c = green_carrier();
+	green_t *g = c -> current;
+
+	c -> action = action;
+	c -> release = release;
+	ctx_switch(&g -> sp, c -> sp);
+}
+
+/** @brief Queues a green thread on a mutex or condition wait queue */
+static void wait_enqueue(green_t **head, green_t **tail, green_t *g)
+{
+	g -> next = NULL;
+	if(*tail != NULL)
+		(*tail) -> next = g;
+	else
+		*head = g;
+	*tail = g;
+}
+
+static green_t *wait_dequeue(green_t **head, green_t **tail)
+{
+	green_t *g = *head;
+
+	if(g != NULL)
+	{
+		*head = g -> next;
+		if(*head == NULL)
+			*tail = NULL;
+	}
+	return g;
+}
+
+/** @brief First code run by a green thread */
+static void green_start(void)
+{
+	green_t *g = green_carrier() -> current;
+
+	green_exit(g -> func(g -> arg));
+}
+
+/** @brief Hands a green thread that has exited to its joiner
+ *
+ *  Runs on the carrier's stack, the thread's own is released here.
+ */
+static void green_finish(green_t *g)
+{
+	green_t *joiner;
+	tcb kjoiner;
+
+	thr_stack_free(g -> block);
+	g -> block = NULL;
+
+	spin_lock(&g -> lock);
+	g -> done = 1;
+	joiner = g -> joiner;
+	kjoiner = g -> kjoiner;
+	spin_unlock(&g -> lock);
+
+	/* g may be freed by its joiner from here on */
+	if(joiner != NULL)
+		green_ready(joiner);
+	if(kjoiner != NULL)
+		thr_unpark(kjoiner);
+}
+
+/** @brief Takes the next ready thread, parking while there is none
+ *
+ *  @return The thread, or NULL once green_shutdown() was called
+ */
+static green_t *green_next(void)
+{
+	tcb self = thr_self();
+	green_t *g;
+
+	spin_lock(&green_lock);
+	while(run_head == NULL && !green_stopping)
+	{
+		thr_park_prepare(self);
+		self -> wait_next = idle_carriers;
+		idle_carriers = self;
+		spin_unlock(&green_lock);
+		thr_park(self);
+		spin_lock(&green_lock);
+	}
+
+	g = run_head;
+	if(g != NULL)
+	{
+		run_head = g -> next;
+		if(run_head == NULL)
+			run_tail = NULL;
+	}
+	spin_unlock(&green_lock);
+
+	return g;
+}
+
+/** @brief Scheduler loop of every carrier */
+static void *green_carrier_main(void *arg)
+{
+	green_carrier_t *c = arg;
+	tcb self = thr_self();
+	green_t *g;
+
+	self -> green_carrier = c;
+
+	while((g = green_next()) != NULL)
+	{
+		c -> current = g;
+		g -> block -> owner = self;
+		ctx_switch(&c -> sp, g -> sp);
+		c -> current = NULL;
+
+		if(c -> release != NULL)
+		{
+			spin_unlock(c -> release);
+			c -> release = NULL;
+		}
+
+		if(c -> action == GREEN_YIELD)
+			green_ready(g);
+		else if(c -> action == GREEN_EXIT)
+			green_finish(g);
+	}
+
+	return NULL;
+}
+
+/** @brief Starts the carriers
+ *
+ *  @param n Number of kernel threads to multiplex onto
+ *  @return 0, or ERROR if they could not be started
+ *
+ *  @pre thr_init should have been called
+ */
+int green_init(int n)
+{
+	void **args;
+	int *tids;
+	int i, created;
+
+	if(n <= 0 || carriers != NULL)
+		return ERROR;
+
+	carriers = calloc(n, sizeof(green_carrier_t));
+	args = malloc(n * sizeof(void *));
+	tids = malloc(n * sizeof(int));
+	if(carriers == NULL || args == NULL || tids == NULL)
+	{
+		free(tids);
+		free(args);
+		free(carriers);
+		carriers = NULL;
+		return ERROR;
+	}
+
+	for(i = 0; i < n; i++)
+		args[i] = &carriers[i];
+
+	created = thr_create_n(green_carrier_main, args, n, tids);
+	if(created < 0)
+		created = 0;
+
+	for(i = 0; i < created; i++)
+		carriers[i].tid = tids[i];
+	ncarriers = created;
+	free(tids);
+	free(args);
+
+	if(created < n)
+	{
+		green_shutdown();
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/** @brief Creates a green thread running func(arg)
+ *
+ *  @return The thread, to be passed to green_join(), or NULL
+ */
+green_t *green_create(void *(*func)(void *), void *arg)
+{
+	green_t *g;
+
+	if(func == NULL || carriers == NULL)
+		return NULL;
+
+	g = calloc(1, sizeof(green_t));
+	if(g == NULL)
+		return NULL;
+
+	g -> block = thr_stack_get();
+	if(g -> block == NULL || thr_stack_commit(g -> block) < 0)
+	{
+		if(g -> block != NULL)
+			thr_stack_free(g -> block);
+		free(g);
+		return NULL;
+	}
+
+	g -> func = func;
+	g -> arg = arg;
+	spin_init(&g -> lock);
+	g -> sp = ctx_init(BLOCK_STACK_TOP(g -> block), green_start);
+
+	green_ready(g);
+	return g;
+}
+
+/** @brief Waits for a green thread to end and frees it
+ *
+ *  A green caller blocks in user space; any other thread parks.
+ *  Each thread is joined exactly once.
+ *
+ *  @return 0, or ERROR if g is NULL
+ */
+int green_join(green_t *g, void **statusp)
+{
+	green_carrier_t *c = green_carrier();
+	tcb self;
+
+	if(g == NULL)
+		return ERROR;
+
+	spin_lock(&g -> lock);
+	if(!g -> done)
+	{
+		if(c != NULL)
+		{
+			g -> joiner = c -> current;
+			green_switch(GREEN_BLOCK, &g -> lock);
+		}
+		else
+		{
+			self = thr_self();
+			thr_park_prepare(self);
+			g -> kjoiner = self;
+			spin_unlock(&g -> lock);
+			thr_park(self);
+		}
+	}
+	else
+		spin_unlock(&g -> lock);
+
+	if(statusp != NULL)
+		*statusp = g -> result;
+	free(g);
+	return SUCCESS;
+}
+
+/** @brief Lets the other ready green threads run
+ *
+ *  Outside a green thread this yields to the kernel instead.
+ */
+void green_yield(void)
+{
+	if(green_carrier() == NULL)
+		yield(-1);
+	else
+		green_switch(GREEN_YIELD, NULL);
+}
+
+/** @brief Ends the calling green thread
+ *
+ *  @param status Handed to green_join()
+ */
+void green_exit(void *status)
+{
+	green_carrier_t *c = green_carrier();
+
+	c -> current -> result = status;
+	green_switch(GREEN_EXIT, NULL);
+}
+
+/** @brief Stops the carriers
+ *
+ *  @return 0, or ERROR if green_init() was not called
+ *
+ *  @pre Every green thread has been joined
+ */
+int green_shutdown(void)
+{
+	tcb idle, next;
+	int i;
+
+	if(carriers == NULL)
+		return ERROR;
+
+	spin_lock(&green_lock);
+	green_stopping = 1;
+	idle = idle_carriers;
+	idle_carriers = NULL;
+	spin_unlock(&green_lock);
+
+	for(; idle != NULL; idle = next)
+	{
+		next = idle -> wait_next;
+		thr_unpark(idle);
+	}
+
+	for(i = 0; i < ncarriers; i++)
+		thr_join(carriers[i].tid, NULL);
+
+	free(carriers);
+	carriers = NULL;
+	ncarriers = 0;
+	green_stopping = 0;
+	return SUCCESS;
+}
+
+int green_mutex_init(green_mutex_t *mp)
+{
+	if(mp == NULL)
+		return ERROR;
+
+	mp -> guard = 0;
+	mp -> locked = 0;
+	mp -> head = NULL;
+	mp -> tail = NULL;
+	return SUCCESS;
+}
+
+/** @brief Locks a green mutex
+ *
+ *  A green thread that has to wait is switched out until the
+ *  holder hands the mutex over; a kernel thread has nothing to
+ *  switch to, so it yields until the mutex is free.
+ */
+void green_mutex_lock(green_mutex_t *mp)
+{
+	green_carrier_t *c = green_carrier();
+
+	spin_lock(GUARD(mp));
+	while(mp -> locked && c == NULL)
+	{
+		spin_unlock(GUARD(mp));
+		yield(-1);
+		spin_lock(GUARD(mp));
+	}
+
+	if(!mp -> locked)
+	{
+		mp -> locked = 1;
+		spin_unlock(GUARD(mp));
+		return;
+	}
+
+	/* green_mutex_unlock() passes the mutex straight to us */
+	wait_enqueue(&mp -> head, &mp -> tail, c -> current);
+	green_switch(GREEN_BLOCK, GUARD(mp));
+}
+
+/** @brief Unlocks a green mutex, handing it to the first waiter */
+void green_mutex_unlock(green_mutex_t *mp)
+{
+	green_t *g;
+
+	spin_lock(GUARD(mp));
+	g = wait_dequeue(&mp -> head, &mp -> tail);
+	if(g == NULL)
+		mp -> locked = 0;
+	spin_unlock(GUARD(mp));
+
+	if(g != NULL)
+		green_ready(g);
+}
+
+int green_cond_init(green_cond_t *cv)
+{
+	if(cv == NULL)
+		return ERROR;
+
+	cv -> guard = 0;
+	cv -> head = NULL;
+	cv -> tail = NULL;
+	return SUCCESS;
+}
+
+/** @brief Waits on a condition, only from a green thread
+ *
+ *  We are on the wait queue before the mutex is dropped, so a
+ *  signal sent after we drop it cannot be missed.
+ */
+void green_cond_wait(green_cond_t *cv, green_mutex_t *mp)
+{
+	green_carrier_t *c = green_carrier();
+
+	spin_lock(GUARD(cv));
+	wait_enqueue(&cv -> head, &cv -> tail, c -> current);
+	green_mutex_unlock(mp);
+	green_switch(GREEN_BLOCK, GUARD(cv));
+
+	green_mutex_lock(mp);
+}
+
+void green_cond_signal(green_cond_t *cv)
+{
+	green_t *g;
+
+	spin_lock(GUARD(cv));
+	g = wait_dequeue(&cv -> head, &cv -> tail);
+	spin_unlock(GUARD(cv));
+
+	if(g != NULL)
+		green_ready(g);
+}
+
+void green_cond_broadcast(green_cond_t *cv)
+{
+	green_t *g, *next;
+
+	spin_lock(GUARD(cv));
+	g = cv -> head;
+	cv -> head = NULL;
+	cv -> tail = NULL;
+	spin_unlock(GUARD(cv));
+
+	for(; g != NULL; g = next)
+	{
+		next = g -> next;
+		green_ready(g);
+	}
+}
@@ -0,0 +1,91 @@
+/** @file latch.c
+ *
+ *  @brief Countdown latches
+ *
+ *  Counting down is one xadd. Only the count down that takes the
+ *  latch to zero goes near the guard, to take every parked waiter
+ *  at once and wake them. A waiter checks the count again under the
+ *  guard before parking, so it cannot park after that sweep.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <latch.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief The guard word of a latch, as a spinlock */
+#define GUARD(l) ((spinlock_t *)&(l) -> guard)
+
+int latch_init(latch_t *l, int count)
+{
+	if(l == NULL || count < 0)
+		return ERROR;
+
+	l -> count = count;
+	l -> guard = 0;
+	l -> waiters = NULL;
+	return SUCCESS;
+}
+
+void latch_count_down(latch_t *l)
+{
+	tcb waiters, next;
+	int count = atomic_xadd(&l -> count, -1);
+
+	if(count <= 0)
+		panic("latch_count_down: latch %p is already open", l);
+	if(count != 1)
+		return;
+
+	spin_lock(GUARD(l));
+	waiters = l -> waiters;
+	l -> waiters = NULL;
+	spin_unlock(GUARD(l));
+
+	for(; waiters != NULL; waiters = next)
+	{
+		next = waiters -> wait_next;
+		thr_unpark(waiters);
+	}
+}
+
+/** @brief Tells whether l is open, without blocking */
+int latch_try_wait(latch_t *l)
+{
+	return l -> count == 0;
+}
+
+void latch_wait(latch_t *l)
+{
+	tcb self;
+
+	if(l -> count == 0)
+		return;
+
+	self = thr_self();
+
+	spin_lock(GUARD(l));
+	if(l -> count == 0)
+	{
+		spin_unlock(GUARD(l));
+		return;
+	}
+	thr_park_prepare(self);
+	self -> wait_next = l -> waiters;
+	l -> waiters = self;
+	spin_unlock(GUARD(l));
+
+	thr_park(self);
+}
+
+void latch_destroy(latch_t *l)
+{
+	if(l -> waiters != NULL)
+		panic("latch_destroy: latch %p has waiters", l);
+}
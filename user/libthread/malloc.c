@@ -3,28 +3,51 @@
  * It is up to you to rewrite them
  * to make them thread safe.
  *
+ * The underlying allocator keeps no per-thread state, so
+ * serialising every call behind one spinlock is enough.
  */
 
 #include <stdlib.h>
 #include <types.h>
 #include <stddef.h>
+#include <malloc.h>
+#include "atomic.h"
+
+static spinlock_t malloc_lock = SPINLOCK_INIT;
 
 void *malloc(size_t __size)
 {
-  return NULL;
+  void *buf;
+
+  spin_lock(&malloc_lock);
+  buf = _malloc(__size);
+  spin_unlock(&malloc_lock);
+  return buf;
 }
 
 void *calloc(size_t __nelt, size_t __eltsize)
 {
-  return NULL;
+  void *buf;
+
+  spin_lock(&malloc_lock);
+  buf = _calloc(__nelt, __eltsize);
+  spin_unlock(&malloc_lock);
+  return buf;
 }
 
 void *realloc(void *__buf, size_t __new_size)
 {
-  return NULL;
+  void *buf;
+
+  spin_lock(&malloc_lock);
+  buf = _realloc(__buf, __new_size);
+  spin_unlock(&malloc_lock);
+  return buf;
 }
 
 void free(void *__buf)
 {
-  return;
+  spin_lock(&malloc_lock);
+  _free(__buf);
+  spin_unlock(&malloc_lock);
 }
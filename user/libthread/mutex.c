@@ -0,0 +1,333 @@
+/** @file mutex.c
+ *
+ *  @brief Adaptive mutexes
+ *
+ *  The lock word is 0 when free, 1 when held and 2 when held with
+ *  threads queued behind it. Taking a free mutex and releasing one
+ *  nobody waits for are a single cmpxchg each.
+ *
+ *  A thread that finds the mutex held first spins briefly, in case
+ *  the holder is about to let go, then gives a few timeslices to
+ *  the holder by kernel id, so the one thread that can make
+ *  progress gets the CPU, and only then queues itself and parks.
+ *  If the holder is not runnable there is nothing to donate to,
+ *  and we queue right away. Queued threads are served
+ *  in order: unlock hands the mutex straight to the first of them,
+ *  which wakes up already owning it, so a queued thread cannot be
+ *  overtaken again by newcomers.
+ *
+ *  A mutex set up with mutex_init_mcs() is an MCS queue lock
+ *  instead: every waiter queues its own node, on its own stack, and
+ *  waits on that node alone, so a hand-off touches only the lock
+ *  and the next waiter's node whatever the contention, and the
+ *  lock is granted strictly in arrival order. The holder needs no
+ *  node of its own: the lock's mcs_head stands in for it, which is
+ *  what lets mutex_lock() return while the holder's queue position
+ *  lives on.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <mutex.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief Tries at the lock word before giving up the CPU */
+#define MUTEX_SPINS 64
+
+/** @brief Timeslices given to the holder before queueing */
+#define MUTEX_YIELDS 2
+
+#define MUTEX_FREE 0
+#define MUTEX_HELD 1
+#define MUTEX_QUEUED 2
+
+/** @brief The guard word of a mutex, as a spinlock */
+#define GUARD(mp) ((spinlock_t *)&(mp) -> guard)
+
+/** @brief Compare and swap on a pointer-sized word */
+#define CAS_PTR(addr, expect, val) \
+  ((void *)atomic_cmpxchg((volatile int *)(addr), (int)(expect), (int)(val)))
+
+int mutex_init( mutex_t *mp )
+{
+	if(mp == NULL)
+		return ERROR;
+
+	mp -> state = MUTEX_FREE;
+	mp -> guard = 0;
+	mp -> owner = NULL;
+	mp -> owner_kid = 0;
+	mp -> head = NULL;
+	mp -> tail = NULL;
+	mp -> mcs = 0;
+	mp -> mcs_tail = NULL;
+	mp -> mcs_head.next = NULL;
+	return SUCCESS;
+}
+
+int mutex_init_mcs( mutex_t *mp )
+{
+	if(mutex_init(mp) < 0)
+		return ERROR;
+
+	mp -> mcs = 1;
+	return SUCCESS;
+}
+
+/** @brief Destroys a mutex
+ *
+ *  Destroying a mutex somebody holds or waits for is a bug in the
+ *  caller, so we stop right there rather than corrupt anything.
+ */
+void mutex_destroy( mutex_t *mp )
+{
+	if(mp -> state != MUTEX_FREE || mp -> head != NULL ||
+	   mp -> mcs_tail != NULL)
+		panic("mutex_destroy: mutex %p is in use", mp);
+}
+
+/** @brief Records who holds the mutex now */
+static void mutex_own(mutex_t *mp, tcb owner)
+{
+	mp -> owner = owner;
+	mp -> owner_kid = owner -> kid;
+}
+
+/** @brief Takes the mutex if it is free
+ *
+ *  @return Nonzero if we now hold it
+ */
+static int mutex_try(mutex_t *mp, tcb self)
+{
+	if(mp -> state != MUTEX_FREE ||
+	   atomic_cmpxchg(&mp -> state, MUTEX_FREE, MUTEX_HELD) != MUTEX_FREE)
+		return 0;
+
+	mutex_own(mp, self);
+	return 1;
+}
+
+/** @brief Takes an MCS mutex
+ *
+ *  A free lock is taken by swinging the tail from NULL to the lock
+ *  itself. Otherwise we append our node, spin on it for a while
+ *  and then park; whoever grants it always unparks us exactly once.
+ *  Once we own the lock, our successor, if any, is moved from our
+ *  node to the lock's, since our node dies when we return.
+ */
+static void mcs_lock(mutex_t *mp, tcb self)
+{
+	mcs_node_t *head = &mp -> mcs_head;
+	mcs_node_t node;
+	mcs_node_t *prev, *succ;
+	int i;
+
+	for(;;)
+	{
+		prev = mp -> mcs_tail;
+		if(prev == NULL)
+		{
+			if(CAS_PTR(&mp -> mcs_tail, NULL, head) == NULL)
+				break;
+			continue;
+		}
+
+		node.next = NULL;
+		node.thread = self;
+		node.granted = 0;
+		thr_park_prepare(self);
+		if(CAS_PTR(&mp -> mcs_tail, prev, &node) != prev)
+			continue;
+
+		prev -> next = &node;
+		for(i = 0; i < MUTEX_SPINS && !node.granted; i++)
+			continue;
+		thr_park(self);
+
+		succ = node.next;
+		if(succ == NULL)
+		{
+			head -> next = NULL;
+			if(CAS_PTR(&mp -> mcs_tail, &node, head) != &node)
+			{
+				/* Somebody is linking in behind us right now */
+				while((succ = node.next) == NULL)
+					yield(-1);
+				head -> next = succ;
+			}
+		}
+		else
+			head -> next = succ;
+		break;
+	}
+
+	mutex_own(mp, self);
+}
+
+/** @brief Releases an MCS mutex to the next node in line */
+static void mcs_unlock(mutex_t *mp)
+{
+	mcs_node_t *head = &mp -> mcs_head;
+	mcs_node_t *succ = head -> next;
+	tcb thread;
+
+	if(succ == NULL)
+	{
+		if(CAS_PTR(&mp -> mcs_tail, head, NULL) == head)
+			return;
+
+		/* Somebody is linking in behind us right now */
+		while((succ = head -> next) == NULL)
+			yield(-1);
+	}
+
+	/* The node dies as soon as its thread runs again */
+	thread = succ -> thread;
+	succ -> granted = 1;
+	thr_unpark(thread);
+}
+
+/** @brief Moves parked threads onto a mutex's wait queue
+ *
+ *  Used by condition variables to hand their waiters to the mutex
+ *  they must reacquire, instead of waking them only to have them
+ *  queue here again. If the mutex is free the first thread gets it
+ *  outright. Not for MCS mutexes, whose waiters queue themselves.
+ *
+ *  @param first First of the threads, linked through wait_next
+ *  @param last Last of them
+ *  @return The thread handed the mutex, which the caller must
+ *          unpark, or NULL
+ */
+tcb mutex_requeue(mutex_t *mp, tcb first, tcb last)
+{
+	tcb owner = NULL;
+
+	last -> wait_next = NULL;
+
+	spin_lock(GUARD(mp));
+	if(atomic_xchg(&mp -> state, MUTEX_QUEUED) == MUTEX_FREE)
+	{
+		owner = first;
+		first = first -> wait_next;
+		mutex_own(mp, owner);
+		if(first == NULL)
+			mp -> state = MUTEX_HELD;
+	}
+
+	if(first != NULL)
+	{
+		if(mp -> tail != NULL)
+			mp -> tail -> wait_next = first;
+		else
+			mp -> head = first;
+		mp -> tail = last;
+	}
+	spin_unlock(GUARD(mp));
+
+	return owner;
+}
+
+void mutex_lock( mutex_t *mp )
+{
+	tcb self = thr_self();
+	int i, kid;
+
+	if(mp -> mcs)
+	{
+		mcs_lock(mp, self);
+		return;
+	}
+
+	for(i = 0; i < MUTEX_SPINS; i++)
+	{
+		if(mutex_try(mp, self))
+			return;
+	}
+
+	for(i = 0; i < MUTEX_YIELDS; i++)
+	{
+		/* Zero while ownership is changing hands */
+		kid = mp -> owner_kid;
+		if(kid == 0)
+			yield(-1);
+		else if(yield(kid) < 0)
+			break;
+		if(mutex_try(mp, self))
+			return;
+	}
+
+	spin_lock(GUARD(mp));
+
+	/* Marking the word makes the holder's unlock look at the queue */
+	if(atomic_xchg(&mp -> state, MUTEX_QUEUED) == MUTEX_FREE)
+	{
+		/* Released under us: nobody queued, or it would not be free */
+		mp -> state = MUTEX_HELD;
+		mutex_own(mp, self);
+		spin_unlock(GUARD(mp));
+		return;
+	}
+
+	thr_park_prepare(self);
+	self -> wait_next = NULL;
+	if(mp -> tail != NULL)
+		mp -> tail -> wait_next = self;
+	else
+		mp -> head = self;
+	mp -> tail = self;
+	spin_unlock(GUARD(mp));
+
+	/* mutex_unlock() makes us the owner before it wakes us */
+	thr_park(self);
+}
+
+/** @brief Releases a mutex, handing it to the first waiter if any
+ *
+ *  Releasing a mutex the caller does not hold is a bug in the
+ *  caller, like destroying one in use, so we stop right there.
+ */
+void mutex_unlock( mutex_t *mp )
+{
+	tcb next;
+
+	if(mp -> owner != thr_self())
+		panic("mutex_unlock: mutex %p not held by caller", mp);
+
+	mp -> owner = NULL;
+	mp -> owner_kid = 0;
+	if(mp -> mcs)
+	{
+		mcs_unlock(mp);
+		return;
+	}
+
+	if(atomic_cmpxchg(&mp -> state, MUTEX_HELD, MUTEX_FREE) == MUTEX_HELD)
+		return;
+
+	spin_lock(GUARD(mp));
+	next = mp -> head;
+	if(next != NULL)
+	{
+		mp -> head = next -> wait_next;
+		if(mp -> head == NULL)
+		{
+			mp -> tail = NULL;
+			mp -> state = MUTEX_HELD;
+		}
+		mutex_own(mp, next);
+	}
+	else
+		mp -> state = MUTEX_FREE;
+	spin_unlock(GUARD(mp));
+
+	if(next != NULL)
+		thr_unpark(next);
+}
@@ -0,0 +1,296 @@
+/** @file parallel.c
+ *
+ *  @brief Data-parallel loops over a thread pool
+ *
+ *  A loop is cut into one part per pool worker plus one for the
+ *  caller. Parts are claimed by ticket, and the caller keeps
+ *  claiming after its own, so a loop started from a busy pool,
+ *  even from inside one of its own tasks, still finishes: parts no
+ *  worker got round to are simply run by the caller.
+ *
+ *  Inside a part the schedule decides what gets run. A static
+ *  part covers one fixed share of the range; dynamic and guided
+ *  parts keep taking chunks off a shared cursor until it passes
+ *  the end.
+ *
+ *  The job lives on the heap and is reference counted, since pool
+ *  tasks that only start after the loop is over still look at it
+ *  on their way out.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <parallel.h>
+#include <thread.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+typedef struct par_job {
+  int begin;
+  int end;
+  int grain;
+  int sched;
+  int nparts;
+
+  void (*for_body)(int, int, void *);
+  void *(*reduce_body)(int, int, void *);
+  void *(*combine)(void *, void *);
+  void *identity;
+  void *arg;
+
+  /* Next part to claim, next index for dynamic and guided parts */
+  volatile int ticket;
+  volatile int cursor;
+
+  /* Parts still running plus one for the caller, and references */
+  volatile int left;
+  volatile int refs;
+  tcb waiter;
+
+  /* What each part folded together, for parallel_reduce() */
+  void **partials;
+} par_job_t;
+
+/** @brief Runs body on one chunk and folds the result in */
+static void *par_chunk(par_job_t *job, int lo, int hi, void *acc)
+{
+	if(job -> for_body != NULL)
+	{
+		job -> for_body(lo, hi, job -> arg);
+		return acc;
+	}
+
+	return job -> combine(acc, job -> reduce_body(lo, hi, job -> arg));
+}
+
+/** @brief Claims the next chunk off the shared cursor
+ *
+ *  @return Start of the chunk, its end in *hi, or end if nothing
+ *          is left
+ */
+static int par_claim(par_job_t *job, int *hi)
+{
+	int lo, size;
+
+	if(job -> sched == PAR_DYNAMIC)
+	{
+		lo = atomic_xadd(&job -> cursor, job -> grain);
+		size = job -> grain;
+	}
+	else
+	{
+		/* Guided: a share of what is left, never below grain */
+		do
+		{
+			lo = job -> cursor;
+			if(lo >= job -> end)
+				return job -> end;
+			size = (job -> end - lo) / (2 * job -> nparts);
+			if(size < job -> grain)
+				size = job -> grain;
+		}
+		while(atomic_cmpxchg(&job -> cursor, lo, lo + size) != lo);
+	}
+
+	if(lo >= job -> end)
+		return job -> end;
+
+	*hi = job -> end - lo > size ? lo + size : job -> end;
+	return lo;
+}
+
+/** @brief Runs part idx of a loop */
+static void par_part(par_job_t *job, int idx)
+{
+	void *acc = job -> identity;
+	int lo, hi, share;
+	tcb waiter;
+
+	if(job -> sched == PAR_STATIC)
+	{
+		share = job -> end - job -> begin + job -> nparts - 1;
+		share /= job -> nparts;
+		lo = job -> begin + idx * share;
+		hi = job -> end - lo > share ? lo + share : job -> end;
+		if(lo < hi)
+			acc = par_chunk(job, lo, hi, acc);
+	}
+	else
+	{
+		while((lo = par_claim(job, &hi)) < job -> end)
+			acc = par_chunk(job, lo, hi, acc);
+	}
+
+	if(job -> partials != NULL)
+		job -> partials[idx] = acc;
+
+	/* The caller may return as soon as left hits zero */
+	waiter = job -> waiter;
+	if(atomic_xadd(&job -> left, -1) == 1)
+		thr_unpark(waiter);
+}
+
+static void par_release(par_job_t *job)
+{
+	if(atomic_xadd(&job -> refs, -1) == 1)
+	{
+		free(job -> partials);
+		free(job);
+	}
+}
+
+/** @brief Claims and runs parts until none are left */
+static void par_run_parts(par_job_t *job)
+{
+	int idx;
+
+	while((idx = atomic_xadd(&job -> ticket, 1)) < job -> nparts)
+		par_part(job, idx);
+}
+
+/** @brief Pool task taking part in a loop */
+static void *par_task(void *arg)
+{
+	par_job_t *job = arg;
+
+	par_run_parts(job);
+	par_release(job);
+	return NULL;
+}
+
+/** @brief Runs a loop to completion
+ *
+ *  @return 0, or ERROR if the arguments are invalid or the job
+ *          could not be allocated
+ */
+static int par_run(thrpool_t *pool, par_job_t *proto, void **resultp)
+{
+	par_job_t *job;
+	tcb self = thr_self();
+	int workers = pool != NULL ? thrpool_size(pool) : 0;
+	int chunks, i;
+	void *acc;
+
+	if(proto -> end <= proto -> begin)
+	{
+		if(resultp != NULL)
+			*resultp = proto -> identity;
+		return SUCCESS;
+	}
+
+	if(proto -> grain <= 0)
+		proto -> grain = 1;
+	if(proto -> sched < PAR_STATIC || proto -> sched > PAR_GUIDED)
+		return ERROR;
+
+	job = malloc(sizeof(par_job_t));
+	if(job == NULL)
+		return ERROR;
+	*job = *proto;
+
+	/* No more parts than there are threads or grain-sized chunks */
+	chunks = (job -> end - job -> begin + job -> grain - 1) / job -> grain;
+	job -> nparts = workers + 1 < chunks ? workers + 1 : chunks;
+	job -> ticket = 0;
+	job -> cursor = job -> begin;
+	job -> left = job -> nparts + 1;
+	job -> refs = job -> nparts;
+	job -> waiter = self;
+	job -> partials = NULL;
+
+	if(job -> combine != NULL)
+	{
+		job -> partials = malloc(job -> nparts * sizeof(void *));
+		if(job -> partials == NULL)
+		{
+			free(job);
+			return ERROR;
+		}
+	}
+
+	/* The caller takes part itself, so one task fewer */
+	for(i = 0; i < job -> nparts - 1; i++)
+	{
+		if(thrpool_submit(pool, par_task, job) < 0)
+			atomic_xadd(&job -> refs, -1);
+	}
+
+	par_run_parts(job);
+
+	/* Nobody wakes us before our own decrement below */
+	thr_park_prepare(self);
+	if(atomic_xadd(&job -> left, -1) != 1)
+		thr_park(self);
+
+	if(job -> partials != NULL)
+	{
+		acc = job -> identity;
+		for(i = 0; i < job -> nparts; i++)
+			acc = job -> combine(acc, job -> partials[i]);
+		*resultp = acc;
+	}
+
+	par_release(job);
+	return SUCCESS;
+}
+
+/** @brief Runs body over [begin, end) in parallel
+ *
+ *  @param pool Pool to borrow threads from, NULL to run serially
+ *  @param grain Smallest chunk handed to body
+ *  @param sched PAR_STATIC, PAR_DYNAMIC or PAR_GUIDED
+ *  @return 0, or ERROR
+ */
+int parallel_for(thrpool_t *pool, int begin, int end, int grain, int sched,
+                 void (*body)(int lo, int hi, void *arg), void *arg)
+{
+	par_job_t job;
+
+	if(body == NULL)
+		return ERROR;
+
+	job.begin = begin;
+	job.end = end;
+	job.grain = grain;
+	job.sched = sched;
+	job.for_body = body;
+	job.reduce_body = NULL;
+	job.combine = NULL;
+	job.identity = NULL;
+	job.arg = arg;
+
+	return par_run(pool, &job, NULL);
+}
+
+/** @brief Folds body's results over [begin, end) in parallel
+ *
+ *  @param identity Neutral element of combine
+ *  @param resultp Receives the folded result
+ *  @return 0, or ERROR
+ */
+int parallel_reduce(thrpool_t *pool, int begin, int end, int grain, int sched,
+                    void *(*body)(int lo, int hi, void *arg),
+                    void *(*combine)(void *a, void *b),
+                    void *identity, void *arg, void **resultp)
+{
+	par_job_t job;
+
+	if(body == NULL || combine == NULL || resultp == NULL)
+		return ERROR;
+
+	job.begin = begin;
+	job.end = end;
+	job.grain = grain;
+	job.sched = sched;
+	job.for_body = NULL;
+	job.reduce_body = body;
+	job.combine = combine;
+	job.identity = identity;
+	job.arg = arg;
+
+	return par_run(pool, &job, resultp);
+}
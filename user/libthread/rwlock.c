@@ -0,0 +1,335 @@
+/** @file rwlock.c
+ *
+ *  @brief Reader/writer locks with distributed reader counters
+ *
+ *  Readers never touch a word shared by every reader. Each thread
+ *  counts itself in on one of RWLOCK_SHARDS counters, picked by its
+ *  thread id and each aligned to a cache line of its own, away from
+ *  the rest of the lock, and then checks the writer flag. With no
+ *  writer about, taking and dropping a read lock is one xadd on a
+ *  line few other readers use.
+ *
+ *  A writer first claims the writer flag, which turns new readers
+ *  away, and then waits for the counters to drain. Both sides use a
+ *  locked instruction between their write and their read, so either
+ *  the reader sees the flag and backs out, or the writer sees the
+ *  reader and waits for it. A reader that leaves while writers are
+ *  draining adds up the counters and wakes them once they come to
+ *  zero.
+ *
+ *  Readers turned away park until they are let in; the thread that
+ *  lets them in counts them in first, so they wake holding the
+ *  lock. A writer that finds the flag taken parks until the lock is
+ *  handed to it, flag and all. The policy decides who goes next
+ *  when a writer leaves:
+ *
+ *  RWLOCK_PREFER_WRITERS: the next writer, and readers only once no
+ *  writer is waiting. Readers can starve.
+ *
+ *  RWLOCK_PREFER_READERS: everybody parked goes, and a writer that
+ *  finds readers inside steps aside until they are all gone.
+ *  Writers can starve.
+ *
+ *  RWLOCK_PHASE_FAIR: every parked reader and then the next writer,
+ *  which turns new readers away again while it waits for the ones
+ *  let in. Read and write phases alternate, so nobody waits longer
+ *  than one phase of each.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <rwlock.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief The guard word of a lock, as a spinlock */
+#define GUARD(rw) ((spinlock_t *)&(rw) -> guard)
+
+/** @brief The counter a thread counts itself in on */
+#define RW_SLOT(rw, t) \
+	(&(rw) -> shard[(t) -> tid & (RWLOCK_SHARDS - 1)].readers)
+
+/** @brief Appends t to the queue from head to tail */
+#define RW_ENQUEUE(head, tail, t) \
+	do { \
+		(t) -> wait_next = NULL; \
+		if((tail) != NULL) \
+			(tail) -> wait_next = (t); \
+		else \
+			(head) = (t); \
+		(tail) = (t); \
+	} while(0)
+
+/** @brief Adds up the reader counters */
+static int rw_readers(rwlock_t *rw)
+{
+	int i, sum = 0;
+
+	for(i = 0; i < RWLOCK_SHARDS; i++)
+		sum += rw -> shard[i].readers;
+	return sum;
+}
+
+/** @brief Unparks a list of threads linked through wait_next */
+static void rw_wake(tcb list)
+{
+	tcb next;
+
+	for(; list != NULL; list = next)
+	{
+		next = list -> wait_next;
+		thr_unpark(list);
+	}
+}
+
+/** @brief Counts every parked reader in and takes them off the queue
+ *
+ *  Called with the guard held.
+ *
+ *  @return The readers, to be woken once the guard is dropped
+ */
+static tcb rw_admit(rwlock_t *rw)
+{
+	tcb readers = rw -> rhead;
+	tcb t;
+
+	for(t = readers; t != NULL; t = t -> wait_next)
+		atomic_xadd(RW_SLOT(rw, t), 1);
+
+	rw -> rhead = NULL;
+	rw -> rtail = NULL;
+	return readers;
+}
+
+/** @brief Counts a reader out, waking draining writers if it was last
+ *
+ *  The xadd comes before the look at drainer, so a writer that
+ *  starts draining after it will count the readers without us.
+ */
+static void rw_read_leave(rwlock_t *rw, volatile int *slot)
+{
+	tcb writers = NULL;
+
+	atomic_xadd(slot, -1);
+	if(rw -> drainer == NULL)
+		return;
+
+	spin_lock(GUARD(rw));
+	if(rw_readers(rw) == 0)
+	{
+		writers = rw -> drainer;
+		rw -> drainer = NULL;
+	}
+	spin_unlock(GUARD(rw));
+
+	rw_wake(writers);
+}
+
+static void rw_read_lock(rwlock_t *rw, tcb self)
+{
+	volatile int *slot = RW_SLOT(rw, self);
+
+	for(;;)
+	{
+		atomic_xadd(slot, 1);
+		if(!rw -> writer)
+			return;
+
+		/* A writer is in or on its way, let it drain */
+		rw_read_leave(rw, slot);
+
+		spin_lock(GUARD(rw));
+		if(rw -> writer)
+			break;
+		spin_unlock(GUARD(rw));
+	}
+
+	thr_park_prepare(self);
+	RW_ENQUEUE(rw -> rhead, rw -> rtail, self);
+	spin_unlock(GUARD(rw));
+
+	/* Whoever wakes us has counted us in */
+	thr_park(self);
+}
+
+/** @brief Parks until the reader counters drain
+ *
+ *  Called and returns with the guard held. readers are woken once
+ *  the guard is first dropped; they are counted in, so we always
+ *  park at least once if there are any.
+ *
+ *  A reader leaving looks at drainer without the guard, so we
+ *  publish ourselves with an xchg and count again: either that
+ *  reader sees us, or we see it gone.
+ */
+static void rw_drain(rwlock_t *rw, tcb self, tcb readers)
+{
+	while(rw_readers(rw) != 0)
+	{
+		thr_park_prepare(self);
+		self -> wait_next = rw -> drainer;
+		atomic_xchg((volatile int *)&rw -> drainer, (int)self);
+		if(rw_readers(rw) == 0)
+		{
+			/* Nobody else moves the head while we hold the guard */
+			rw -> drainer = self -> wait_next;
+			break;
+		}
+		spin_unlock(GUARD(rw));
+
+		rw_wake(readers);
+		readers = NULL;
+
+		thr_park(self);
+		spin_lock(GUARD(rw));
+	}
+}
+
+static void rw_write_lock(rwlock_t *rw, tcb self)
+{
+	spin_lock(GUARD(rw));
+	for(;;)
+	{
+		if(rw -> writer)
+		{
+			/* Wait to be handed the flag by the writer leaving */
+			thr_park_prepare(self);
+			RW_ENQUEUE(rw -> whead, rw -> wtail, self);
+			spin_unlock(GUARD(rw));
+			thr_park(self);
+			spin_lock(GUARD(rw));
+		}
+		else
+		{
+			/* The xchg orders the flag before the counter reads */
+			atomic_xchg(&rw -> writer, 1);
+			rw -> owner = self;
+		}
+
+		if(rw -> policy != RWLOCK_PREFER_READERS || rw_readers(rw) == 0)
+			break;
+
+		/* Readers first: let them in and retry once they are gone */
+		rw -> owner = NULL;
+		rw -> writer = 0;
+		rw_drain(rw, self, rw_admit(rw));
+	}
+
+	rw_drain(rw, self, NULL);
+	spin_unlock(GUARD(rw));
+}
+
+/** @brief Lets go of the writer's hold and lets in whoever is next */
+static void rw_write_leave(rwlock_t *rw)
+{
+	tcb readers = NULL;
+	tcb writer;
+
+	spin_lock(GUARD(rw));
+	writer = rw -> whead;
+	if(writer == NULL || rw -> policy != RWLOCK_PREFER_WRITERS)
+		readers = rw_admit(rw);
+
+	if(writer != NULL)
+	{
+		/* Hand the flag straight over, so no reader slips in */
+		rw -> whead = writer -> wait_next;
+		if(rw -> whead == NULL)
+			rw -> wtail = NULL;
+		rw -> owner = writer;
+	}
+	else
+	{
+		rw -> owner = NULL;
+		rw -> writer = 0;
+	}
+	spin_unlock(GUARD(rw));
+
+	rw_wake(readers);
+	if(writer != NULL)
+		thr_unpark(writer);
+}
+
+int rwlock_init( rwlock_t *rwlock )
+{
+	return rwlock_init_policy(rwlock, RWLOCK_PREFER_WRITERS);
+}
+
+int rwlock_init_policy( rwlock_t *rwlock, int policy )
+{
+	int i;
+
+	if(rwlock == NULL || policy < RWLOCK_PREFER_WRITERS ||
+	   policy > RWLOCK_PHASE_FAIR)
+		return ERROR;
+
+	rwlock -> writer = 0;
+	rwlock -> guard = 0;
+	rwlock -> owner = NULL;
+	rwlock -> policy = policy;
+	rwlock -> drainer = NULL;
+	rwlock -> rhead = NULL;
+	rwlock -> rtail = NULL;
+	rwlock -> whead = NULL;
+	rwlock -> wtail = NULL;
+	for(i = 0; i < RWLOCK_SHARDS; i++)
+		rwlock -> shard[i].readers = 0;
+	return SUCCESS;
+}
+
+void rwlock_lock( rwlock_t *rwlock, int type )
+{
+	tcb self = thr_self();
+
+	if(type == RWLOCK_WRITE)
+		rw_write_lock(rwlock, self);
+	else if(type == RWLOCK_READ)
+		rw_read_lock(rwlock, self);
+	else
+		panic("rwlock_lock: bad lock type %d", type);
+}
+
+/** @brief Drops whichever hold the caller has on rwlock
+ *
+ *  The writer is the recorded owner; anybody else is a reader and
+ *  counts itself out on the counter it counted itself in on.
+ */
+void rwlock_unlock( rwlock_t *rwlock )
+{
+	tcb self = thr_self();
+
+	if(rwlock -> owner == self)
+		rw_write_leave(rwlock);
+	else
+		rw_read_leave(rwlock, RW_SLOT(rwlock, self));
+}
+
+/** @brief Turns the caller's write hold into a read hold
+ *
+ *  We count ourselves in as a reader before letting go of the
+ *  flag, so a writer handed it waits for us like any reader.
+ */
+void rwlock_downgrade( rwlock_t *rwlock )
+{
+	tcb self = thr_self();
+
+	if(rwlock -> owner != self)
+		panic("rwlock_downgrade: %p not write-locked by caller",
+		      rwlock);
+
+	atomic_xadd(RW_SLOT(rwlock, self), 1);
+	rw_write_leave(rwlock);
+}
+
+void rwlock_destroy( rwlock_t *rwlock )
+{
+	if(rwlock -> writer || rwlock -> rhead != NULL ||
+	   rwlock -> whead != NULL || rwlock -> drainer != NULL ||
+	   rw_readers(rwlock) != 0)
+		panic("rwlock_destroy: lock %p is in use", rwlock);
+}
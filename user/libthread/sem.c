@@ -0,0 +1,100 @@
+/** @file sem.c
+ *
+ *  @brief Semaphores with a lock-free fast path
+ *
+ *  The count is a single word changed with xadd. As long as it
+ *  stays positive, sem_wait() and sem_signal() are one atomic
+ *  instruction each. Below zero it counts the threads committed to
+ *  waiting, and only those threads, and the signals meant for them,
+ *  go near the wait queue or the kernel.
+ *
+ *  A waiter commits by taking the count below zero but queues
+ *  itself a little later, so a signal can arrive in between and
+ *  find nobody to wake. It then leaves a wakeup behind, which the
+ *  waiter takes instead of parking.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <sem.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief The guard word of a semaphore, as a spinlock */
+#define GUARD(sem) ((spinlock_t *)&(sem) -> guard)
+
+int sem_init( sem_t *sem, int count )
+{
+	if(sem == NULL || count < 0)
+		return ERROR;
+
+	sem -> count = count;
+	sem -> guard = 0;
+	sem -> wakeups = 0;
+	sem -> head = NULL;
+	sem -> tail = NULL;
+	return SUCCESS;
+}
+
+void sem_destroy( sem_t *sem )
+{
+	if(sem -> count < 0 || sem -> head != NULL)
+		panic("sem_destroy: semaphore %p has waiters", sem);
+}
+
+void sem_wait( sem_t *sem )
+{
+	tcb self;
+
+	if(atomic_xadd(&sem -> count, -1) > 0)
+		return;
+
+	self = thr_self();
+
+	spin_lock(GUARD(sem));
+	if(sem -> wakeups > 0)
+	{
+		sem -> wakeups--;
+		spin_unlock(GUARD(sem));
+		return;
+	}
+
+	thr_park_prepare(self);
+	self -> wait_next = NULL;
+	if(sem -> tail != NULL)
+		sem -> tail -> wait_next = self;
+	else
+		sem -> head = self;
+	sem -> tail = self;
+	spin_unlock(GUARD(sem));
+
+	thr_park(self);
+}
+
+void sem_signal( sem_t *sem )
+{
+	tcb waiter;
+
+	if(atomic_xadd(&sem -> count, 1) >= 0)
+		return;
+
+	spin_lock(GUARD(sem));
+	waiter = sem -> head;
+	if(waiter != NULL)
+	{
+		sem -> head = waiter -> wait_next;
+		if(sem -> head == NULL)
+			sem -> tail = NULL;
+	}
+	else
+		sem -> wakeups++;
+	spin_unlock(GUARD(sem));
+
+	if(waiter != NULL)
+		thr_unpark(waiter);
+}
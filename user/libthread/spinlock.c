@@ -0,0 +1,32 @@
+/** @file spinlock.c
+ *
+ *  @brief Spinlocks for internal thread library state
+ *
+ *  These guard short critical sections (registry buckets,
+ *  free lists). A waiter yields its timeslice instead of
+ *  burning it, since on a uniprocessor the holder can only
+ *  make progress once we get off the CPU.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include "atomic.h"
+#include <syscall.h>
+
+void spin_init(spinlock_t *lock)
+{
+	lock->held = 0;
+}
+
+void spin_lock(spinlock_t *lock)
+{
+	while(atomic_xchg(&lock->held, 1))
+		yield(-1);
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+	atomic_xchg(&lock->held, 0);
+}
@@ -0,0 +1,290 @@
+/** @file tcb_registry.c
+ *
+ *  @brief Hashed registry of thread control blocks
+ *
+ *  Every live TCB is chained into a hash table keyed by the
+ *  library thread id. Each bucket has its own spinlock, so
+ *  threads touching different buckets never contend.
+ *
+ *  The table doubles whenever an insert finds its chain already
+ *  TCB_CHAIN_MAX long, so chains stay short and lookups cost the
+ *  same however many threads exist. Tids are handed out in order,
+ *  so they spread evenly over the buckets and one long chain means
+ *  they are all getting long. Growing takes every bucket lock of
+ *  the old table, moves the TCBs over and only then publishes the
+ *  new table; a thread that locked a bucket of a table which is no
+ *  longer current just tries again. Old tables are never freed, so
+ *  such a thread never touches freed memory; together they are
+ *  never bigger than the current one.
+ *
+ *  A TCB enters the table when thr_create() hands out its id.
+ *  Nothing looks threads up by kernel id: a thread finds its own
+ *  TCB from its stack pointer, see thr_self().
+ *
+ *  TCBs themselves are allocated here too, cache-line aligned
+ *  from slabs so two threads never share a TCB line.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include "thr_private.h"
+#include "atomic.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Number of buckets to start with, must be a power of two */
+#define TCB_BUCKETS 1024
+
+/** @brief Chain length at which an insert grows the table */
+#define TCB_CHAIN_MAX 4
+
+/** @brief One hash chain and the lock protecting it */
+typedef struct tcb_bucket {
+  spinlock_t lock;
+  tcb head;
+} tcb_bucket;
+
+/** @brief A table of buckets, the count a power of two */
+typedef struct tcb_table {
+  unsigned int mask;
+  tcb_bucket * buckets;
+} tcb_table;
+
+#define TCB_HASH(t, id) ((unsigned int)(id) & (t) -> mask)
+
+static tcb_bucket first_buckets[TCB_BUCKETS];
+static tcb_table first_table = { TCB_BUCKETS - 1, first_buckets };
+
+/** @brief The current table */
+static tcb_table * volatile tid_table = &first_table;
+
+/** @brief Lets only one thread grow the table at a time */
+static spinlock_t grow_lock = SPINLOCK_INIT;
+
+/** @brief Number of TCBs carved out of one malloc'd slab */
+#define TCB_SLAB_COUNT 32
+
+/** @brief Free TCBs, carved from cache-line aligned slabs */
+static spinlock_t tcb_alloc_lock = SPINLOCK_INIT;
+static tcb tcb_free_head;
+
+/** @brief Refills the TCB free list with a new slab
+ *
+ *  Called with tcb_alloc_lock held. Slabs are never given back,
+ *  which is what keeps every TCB on its own cache lines.
+ */
+static void tcb_slab_grow(void)
+{
+	char * mem = malloc(TCB_SLAB_COUNT * TCB_SIZE + CACHE_LINE);
+	tcb slab;
+	int i;
+
+	if(mem == NULL)
+		return;
+
+	slab = (tcb)(((unsigned int)mem + CACHE_LINE - 1) & ~(CACHE_LINE - 1));
+	for(i = 0; i < TCB_SLAB_COUNT; i++)
+	{
+		slab[i].free_next = tcb_free_head;
+		tcb_free_head = &slab[i];
+	}
+}
+
+/** @brief Allocates a cleared, cache-line aligned TCB
+ *
+ *  TCBs live apart from thread stacks so that a thread's exit
+ *  status outlives the stack it ran on.
+ *
+ *  @return The new TCB, or NULL
+ */
+tcb tcb_alloc(void)
+{
+	tcb name;
+
+	spin_lock(&tcb_alloc_lock);
+	if(tcb_free_head == NULL)
+		tcb_slab_grow();
+	name = tcb_free_head;
+	if(name != NULL)
+		tcb_free_head = name->free_next;
+	spin_unlock(&tcb_alloc_lock);
+
+	if(name != NULL)
+		memset(name, 0, offsetof(tcb_struct, free_next));
+	return name;
+}
+
+/** @brief Allocates n cleared TCBs under one lock acquisition
+ *
+ *  @return The TCBs linked through free_next, or NULL if not all
+ *          n could be allocated
+ */
+tcb tcb_alloc_n(int n)
+{
+	tcb list = NULL;
+	tcb name;
+	int got;
+
+	spin_lock(&tcb_alloc_lock);
+	for(got = 0; got < n; got++)
+	{
+		if(tcb_free_head == NULL)
+			tcb_slab_grow();
+		name = tcb_free_head;
+		if(name == NULL)
+			break;
+		tcb_free_head = name->free_next;
+		name->free_next = list;
+		list = name;
+	}
+
+	if(got < n)
+	{
+		/* All or nothing */
+		while(list != NULL)
+		{
+			name = list;
+			list = name->free_next;
+			name->free_next = tcb_free_head;
+			tcb_free_head = name;
+		}
+	}
+	spin_unlock(&tcb_alloc_lock);
+
+	for(name = list; name != NULL; name = name->free_next)
+		memset(name, 0, offsetof(tcb_struct, free_next));
+	return list;
+}
+
+/** @brief Returns a TCB to the free list */
+void tcb_free(tcb name)
+{
+	spin_lock(&tcb_alloc_lock);
+	name->free_next = tcb_free_head;
+	tcb_free_head = name;
+	spin_unlock(&tcb_alloc_lock);
+}
+
+/** @brief Locks the bucket tid belongs in, in the current table */
+static tcb_bucket *tcb_bucket_lock(int tid)
+{
+	tcb_table *t;
+	tcb_bucket *b;
+
+	for(;;)
+	{
+		t = tid_table;
+		b = &t -> buckets[TCB_HASH(t, tid)];
+		spin_lock(&b -> lock);
+		if(t == tid_table)
+			return b;
+
+		/* Grown under us, everything has moved */
+		spin_unlock(&b -> lock);
+	}
+}
+
+/** @brief Doubles the table, unless somebody already has
+ *
+ *  If the new buckets cannot be allocated the chains just stay
+ *  longer than they should.
+ */
+static void tcb_table_grow(tcb_table *old)
+{
+	unsigned int n = old -> mask + 1;
+	unsigned int i;
+	tcb_table *new;
+	tcb_bucket *b;
+	tcb entry, next;
+
+	spin_lock(&grow_lock);
+	if(tid_table != old)
+	{
+		spin_unlock(&grow_lock);
+		return;
+	}
+
+	new = malloc(sizeof(tcb_table) + 2 * n * sizeof(tcb_bucket));
+	if(new == NULL)
+	{
+		spin_unlock(&grow_lock);
+		return;
+	}
+	new -> mask = 2 * n - 1;
+	new -> buckets = (tcb_bucket *)(new + 1);
+	memset(new -> buckets, 0, 2 * n * sizeof(tcb_bucket));
+
+	for(i = 0; i < n; i++)
+		spin_lock(&old -> buckets[i].lock);
+
+	for(i = 0; i < n; i++)
+	{
+		for(entry = old -> buckets[i].head; entry != NULL; entry = next)
+		{
+			next = entry -> tid_next;
+			b = &new -> buckets[TCB_HASH(new, entry -> tid)];
+			entry -> tid_next = b -> head;
+			b -> head = entry;
+		}
+		old -> buckets[i].head = NULL;
+	}
+
+	/* Publish only once every TCB has moved over */
+	atomic_xchg((volatile int *)&tid_table, (int)new);
+
+	for(i = 0; i < n; i++)
+		spin_unlock(&old -> buckets[i].lock);
+	spin_unlock(&grow_lock);
+}
+
+void tcb_registry_insert_tid(tcb entry)
+{
+	tcb_table *t;
+	tcb_bucket *b = tcb_bucket_lock(entry -> tid);
+	tcb temp;
+	int len = 0;
+
+	for(temp = b -> head; temp != NULL; temp = temp -> tid_next)
+		len++;
+	entry -> tid_next = b -> head;
+	b -> head = entry;
+	t = tid_table;
+	spin_unlock(&b -> lock);
+
+	if(len >= TCB_CHAIN_MAX)
+		tcb_table_grow(t);
+}
+
+void tcb_registry_remove(tcb entry)
+{
+	tcb_bucket *b = tcb_bucket_lock(entry -> tid);
+	tcb *link;
+
+	for(link = &b -> head; *link; link = &(*link) -> tid_next)
+	{
+		if(*link == entry)
+		{
+			*link = entry -> tid_next;
+			break;
+		}
+	}
+	spin_unlock(&b -> lock);
+}
+
+tcb get_tcb_from_tid(int tid)
+{
+	tcb_bucket *b = tcb_bucket_lock(tid);
+	tcb temp;
+
+	for(temp = b -> head; temp != NULL; temp = temp -> tid_next)
+	{
+		if(temp -> tid == tid)
+			break;
+	}
+	spin_unlock(&b -> lock);
+
+	return temp;
+}
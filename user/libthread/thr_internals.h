@@ -13,6 +13,21 @@
 extern void * stack_high_ptr;
 extern void * stack_low_ptr;
 
+/** @brief Address space kept below the root stack for it to grow into */
+#define ROOT_STACK_RESERVE (16 * 1024 * 1024)
+
+/** @brief Size of the stack a stack fault handler runs on */
+#define AUTOSTACK_EXN_SIZE 1024
+
+/** @brief A stack committed on demand, see autostack.c */
+typedef struct autostack {
+  unsigned int low;   /* lowest mapped address */
+  unsigned int limit; /* lowest address it may grow down to */
+  void * exn_stack;   /* top of the stack the fault handler runs on */
+} autostack_t;
+
+int autostack_attach(autostack_t *as);
+
 /*EDIT: REMOVE LATE */
 int thread_fork(void *stack);
 /* unsigned errno codes */
@@ -0,0 +1,48 @@
+/** @file thr_park.c
+ *
+ *  @brief Blocking and waking threads inside the library
+ *
+ *  A thread that has to wait for another one clears its wake
+ *  flag with thr_park_prepare(), publishes itself wherever its
+ *  waker will look (a wait list, a state word), and only then
+ *  calls thr_park(). The waker calls thr_unpark(), which sets
+ *  the flag and makes the thread runnable. deschedule() refuses
+ *  to sleep once the flag is set, so the wakeup cannot be lost
+ *  no matter how the two race.
+ *
+ *  A thread waits on one thing at a time, so the single wake
+ *  flag and the wait_next link in its TCB are all it needs.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include "thr_private.h"
+#include <syscall.h>
+
+/** @brief Arms the caller's wake flag, before it can be woken */
+void thr_park_prepare(tcb self)
+{
+	self -> wake = 0;
+}
+
+/** @brief Blocks until somebody calls thr_unpark() on us */
+void thr_park(tcb self)
+{
+	while(!self -> wake)
+		deschedule((int *)&self -> wake);
+}
+
+/** @brief Wakes a thread blocked in thr_park()
+ *
+ *  The woken thread may return, exit and free its TCB as soon as
+ *  the flag is set, so its kernel id is read beforehand.
+ */
+void thr_unpark(tcb name)
+{
+	int kid = name -> kid;
+
+	name -> wake = 1;
+	make_runnable(kid);
+}
@@ -7,32 +7,64 @@
 #ifndef THR_PRIVATE
 #define THR_PRIVATE
 
+#include <thr_internals.h>
+#include <thread_ext.h>
+#include <tls.h>
+#include <mutex.h>
+#include <syscall.h>
 
 typedef struct tcb   tcb_struct;
 typedef tcb_struct* tcb;
 
-typedef struct threadList children_list;
+typedef struct stack_block stack_block;
 
-/** @brief children list */
+/** @brief Size of a cache line, TCBs are aligned to it */
+#define CACHE_LINE 64
 
-struct threadList {
-  children_list * next;
-  tcb name;
-};
-
-/** @brief TCB Struct */
+/** @brief TCB Struct
+ *
+ *  The first cache line holds only what other threads write
+ *  during the exit/join handshake. Everything else is written
+ *  at create, exit or reap time and lives in the lines after
+ *  it, so polling or updating one thread's state never drags
+ *  its neighbours' lines around.
+ */
 
 struct tcb {
-  void * sp;
-  unsigned int tid;
+  /* Synchronization state */
+  volatile int state;
+  volatile int wake;
   unsigned int kid;
-  struct tcb * next;
+  void* exit_status;
+  struct tcb * wait_next;
+
+  /* Identity and registry links */
+  unsigned int tid __attribute__((aligned(CACHE_LINE)));
+  struct tcb * tid_next;
+  void * sp;
+  stack_block * block;
   void *(*func)(void*);
   void * arg;
-  int status;
-  void* exit_status;
-  int waiter;
-  children_list * children;
+
+  /* User-level runtimes hosted by this thread */
+  void * fj_worker;     /* see forkjoin.c */
+  void * green_carrier; /* see green.c */
+
+  /* Thread-local storage slots, see tls.c */
+  void * tls[TLS_KEYS];
+
+  /* Allocator free list */
+  struct tcb * free_next;
+} __attribute__((aligned(CACHE_LINE)));
+
+/** @brief Header at the top of every thread stack block */
+
+struct stack_block {
+  tcb owner;
+  autostack_t stack;
+  int lazy;
+  volatile int done;
+  stack_block * free_next;
 };
 
 /** @brief word size */
@@ -40,43 +72,110 @@ struct tcb {
 
 #define TCB_SIZE sizeof(tcb_struct)
 
+#define BLOCK_HDR_SIZE sizeof(stack_block)
+
 #define STACK_BUFFER 16
 
 #define TCB_NOT_FOUND NULL
 
 #define THREAD_NOT_CREATED -1
 
-#define setDone(t) ((t) -> status = 1)
-#define isDone(t) ((t) -> status & 1)
+/** @brief Bits of tcb state
+ *
+ *  Once a joiner claims a thread, the rest of the state word is
+ *  the joiner's TCB pointer, so the whole exit/join handshake is
+ *  decided by cmpxchg on this one word.
+ */
+#define THR_EXITED 1
+#define THR_DETACHED 2
+#define THR_JOINED 4
+#define THR_STATE_BITS 7
+
+#define THR_JOINER(s) ((tcb)((s) & ~THR_STATE_BITS))
+
+#define isExited(t) ((t) -> state & THR_EXITED)
+#define isDetached(t) ((t) -> state & THR_DETACHED)
 
-/** @brief Stack size */
-unsigned int stack_size;
+/** @brief Stack size, see thread_library_main.c */
+extern unsigned int stack_size;
+
+/** @brief Size of a thread stack block, see thr_stack.c */
+extern unsigned int stack_block_size;
+
+/** @brief Every thread block lies below this address */
+extern unsigned int stack_region_top;
+
+/** @brief TCB of the root thread */
+extern tcb root_tcb;
+
+/** @brief Initial stack pointer of a thread running on block */
+#define BLOCK_STACK_TOP(block) \
+  ((void *)((unsigned int)(block) - AUTOSTACK_EXN_SIZE - STACK_BUFFER))
+
+/** @brief Header at the top of the block holding stack address sp */
+#define BLOCK_FROM_SP(sp) \
+  ((stack_block *)((((unsigned int)(sp)) | (stack_block_size - 1)) + 1 - \
+                   BLOCK_HDR_SIZE))
+
+int thr_stack_init(unsigned int size);
+
+int thr_stack_alloc(tcb name);
+
+int thr_stack_alloc_n(tcb names);
+
+stack_block * thr_stack_get(void);
+
+int thr_stack_commit(stack_block *block);
+
+stack_block * thr_stack_get_small(unsigned int size);
+
+void thr_stack_free(stack_block *block);
+
+void thr_stack_zombie(stack_block *block);
+
+void thr_stack_reap(void);
+
+void thr_stack_attach(stack_block *block);
+
+/** @brief Sets *done and vanishes without touching the stack again */
+void thread_vanish(volatile int *done) NORETURN;
+
+tcb thr_self(void);
 
 /** @brief Thread fork system call */
 int thread_fork(void *stack);
 
-/** @brief List of tcbs*/
-tcb tcb_head;
+/** @brief User-level context switch, see ctx_switch.S */
+void ctx_switch(void **save_sp, void *load_sp);
+
+void * ctx_init(void *top, void (*entry)(void));
+
+/** @brief Hands parked condition waiters to a mutex, see mutex.c */
+tcb mutex_requeue(mutex_t *mp, tcb first, tcb last);
 
-void insert_tcb_list(tcb);
+/** @brief Runs the TLS destructors of an exiting thread */
+void tls_run_destructors(tcb self);
 
-tcb get_tcb(int pid);
+/** @brief Blocking the current thread, see thr_park.c */
+void thr_park_prepare(tcb self);
 
-tcb get_tcb_from_tid(int pid);
+void thr_park(tcb self);
 
-tcb get_tcb_from_kid(int kid);
+void thr_unpark(tcb name);
 
-void push_children(children_list **head,tcb child);
+/** @brief TCB allocation, see tcb_registry.c */
+tcb tcb_alloc(void);
 
-//void remove_children(children_list **head,tcb child);
+tcb tcb_alloc_n(int n);
 
-void free_child_thread_list(children_list * head);
+void tcb_free(tcb name);
 
-void freeThread(tcb thread);
+/** @brief Registry of live tcbs, see tcb_registry.c */
+void tcb_registry_insert_tid(tcb entry);
 
-void remove_tcb_from_list(tcb entry);
+void tcb_registry_remove(tcb entry);
 
-void print_tcb_list();
+tcb get_tcb_from_tid(int tid);
 
 #endif /* THR_PRIVATE */
 
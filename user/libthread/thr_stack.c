@@ -0,0 +1,582 @@
+/** @file thr_stack.c
+ *
+ *  @brief Thread stack blocks and current-thread lookup
+ *
+ *  Every thread created by thr_create() runs on a block of
+ *  stack_block_size bytes, a power of two, aligned to its own
+ *  size. A stack_block header sits at the very top of the block
+ *  and the stack grows down from just below it:
+ *
+ *      base                                  base + stack_block_size
+ *      | guard | <-- stack grows -- | STACK_BUFFER | exn stack | hdr |
+ *
+ *  so any address on a thread's stack can be rounded up to the
+ *  end of its block to find the header, and through it the TCB
+ *  of the thread running there, with no system call and no
+ *  registry lookup. The root thread runs on the stack the kernel
+ *  gave us, which lies above every block and is recognised by
+ *  comparing against stack_region_top.
+ *
+ *  Blocks live in their own region of the address space, carved
+ *  downward starting ROOT_STACK_RESERVE below the root stack, and
+ *  are mapped with new_pages() directly; the malloc heap is never
+ *  involved. Only the top stack_map_size bytes of a block are
+ *  mapped, and the rest (at least a page) stays unmapped, so a
+ *  thread that overflows its stack faults instead of scribbling
+ *  over its neighbour's block.
+ *
+ *  With thr_stack_lazy() enabled, new blocks get only their top
+ *  page mapped and each thread attaches an autostack_t that maps
+ *  the rest a page at a time as the stack grows into it; the
+ *  exception stack below the header is what its fault handler
+ *  runs on. Pages of a lazy block are mapped one by one, so they
+ *  are also released one by one.
+ *
+ *  A thread cannot release the block it is running on, so an
+ *  exiting thread queues its block as a zombie and, as the very
+ *  last store before entering the kernel for good, sets the
+ *  block's done flag (see thread_vanish.S). From then on nothing
+ *  touches the block again, and thr_stack_reap(), run by the next
+ *  thr_create() or thr_join(), reclaims it whether or not anybody
+ *  ever joins the thread.
+ *
+ *  Reclaimed blocks are kept on a bounded cache and handed
+ *  straight back to the next thr_create(), stack contents and
+ *  all, so create/exit churn neither enters the kernel nor clears
+ *  memory it is about to overwrite anyway. Blocks that do not fit
+ *  in the cache are unmapped and their address range is
+ *  remembered for the next block we map.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include<thr_internals.h>
+#include "thr_private.h"
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "atomic.h"
+
+/** @brief Default number of released blocks kept for reuse */
+#define STACK_CACHE_DEFAULT_LIMIT 64
+
+/** @brief Size of a thread block, a power of two */
+unsigned int stack_block_size;
+
+/** @brief Every thread block lies below this address */
+unsigned int stack_region_top;
+
+/** @brief TCB of the thread that called thr_init() */
+tcb root_tcb;
+
+/** @brief Whether new blocks are committed on demand */
+static int stack_lazy;
+
+/** @brief Bytes mapped at the top of every block */
+static unsigned int stack_map_size;
+
+/** @brief Lowest block address handed out so far */
+static unsigned int region_next;
+
+/** @brief Protects everything below */
+static spinlock_t stack_lock = SPINLOCK_INIT;
+
+/** @brief Unmapped blocks below region_next that can be mapped again */
+static unsigned int * free_blocks;
+static unsigned int free_count;
+static unsigned int free_max;
+
+/** @brief Cache of released, still mapped, blocks */
+static stack_block * cache_head;
+static unsigned int cache_limit = STACK_CACHE_DEFAULT_LIMIT;
+static thr_stack_cache_stats_t cache_stats;
+
+/** @brief Blocks of exited threads waiting to be reclaimed */
+static stack_block * zombie_head;
+
+/** @brief Computes the block layout for stacks of size bytes
+ *
+ *  @param size Usable stack size requested in thr_init()
+ *  @return SUCCESS, or ERROR if the block would not fit
+ */
+int thr_stack_init(unsigned int size)
+{
+	unsigned int need = size + BLOCK_HDR_SIZE + AUTOSTACK_EXN_SIZE +
+	                    STACK_BUFFER;
+
+	stack_map_size = (need + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	if(stack_map_size < need)
+		return ERROR;
+
+	/* Leave at least one unmapped guard page at the bottom */
+	stack_block_size = PAGE_SIZE;
+	while(stack_block_size < stack_map_size + PAGE_SIZE)
+	{
+		if(stack_block_size & 0x80000000)
+			return ERROR;
+		stack_block_size <<= 1;
+	}
+
+	if((unsigned int)stack_low_ptr < ROOT_STACK_RESERVE + stack_block_size)
+		return ERROR;
+
+	stack_region_top = ((unsigned int)stack_low_ptr - ROOT_STACK_RESERVE) &
+		~(stack_block_size - 1);
+	region_next = stack_region_top;
+	return SUCCESS;
+}
+
+/** @brief Picks an unmapped block, reusing released address ranges first
+ *
+ *  @return Base of the block, or 0 if the address space ran out
+ */
+static unsigned int block_get(void)
+{
+	unsigned int base = 0;
+
+	spin_lock(&stack_lock);
+	if(free_count > 0)
+		base = free_blocks[--free_count];
+	else if(region_next >= 2 * stack_block_size)
+	{
+		region_next -= stack_block_size;
+		base = region_next;
+	}
+	spin_unlock(&stack_lock);
+
+	return base;
+}
+
+/** @brief Remembers an unmapped block so it can be mapped again */
+static void block_put(unsigned int base)
+{
+	unsigned int * grown;
+
+	spin_lock(&stack_lock);
+	if(free_count == free_max)
+	{
+		grown = realloc(free_blocks,
+		                2 * (free_max + 16) * sizeof(unsigned int));
+		if(grown == NULL)
+		{
+			/* Leak the address range, not the pages */
+			spin_unlock(&stack_lock);
+			return;
+		}
+		free_blocks = grown;
+		free_max = 2 * (free_max + 16);
+	}
+	free_blocks[free_count++] = base;
+	spin_unlock(&stack_lock);
+}
+
+/** @brief Gives a block's pages back to the kernel */
+static void block_unmap(stack_block *block)
+{
+	unsigned int base = (unsigned int)block & ~(stack_block_size - 1);
+	unsigned int page = block->stack.low;
+
+	if(block->lazy)
+	{
+		for(; page < base + stack_block_size; page += PAGE_SIZE)
+			remove_pages((void *)page);
+	}
+	else
+		remove_pages((void *)page);
+
+	block_put(base);
+}
+
+/** @brief Maps a fresh block
+ *
+ *  @param lazy Nonzero to map only the top page
+ *  @return The block's header, or NULL if no block could be mapped
+ */
+static stack_block * block_map(int lazy)
+{
+	unsigned int base;
+	stack_block * block;
+
+	base = block_get();
+	if(base == 0)
+		return NULL;
+
+	block = (stack_block *)(base + stack_block_size - BLOCK_HDR_SIZE);
+	block->lazy = lazy;
+	block->stack.limit = base + stack_block_size - stack_map_size;
+	block->stack.low = block->lazy ? base + stack_block_size - PAGE_SIZE :
+		block->stack.limit;
+	block->stack.exn_stack = block;
+	if(new_pages((void *)block->stack.low,
+	             base + stack_block_size - block->stack.low) < 0)
+	{
+		block_put(base);
+		return NULL;
+	}
+
+	return block;
+}
+
+/** @brief Hands a block to the thread that will run on it
+ *
+ *  Only the header is reset; the stack itself is handed out as is.
+ */
+static void block_bind(stack_block *block, tcb name)
+{
+	block->owner = name;
+	block->done = 0;
+	block->free_next = NULL;
+	name->block = block;
+	name->sp = BLOCK_STACK_TOP(block);
+}
+
+/** @brief Takes a block off the cache
+ *
+ *  @return The block, or NULL if the cache is empty
+ */
+static stack_block * cache_pop(void)
+{
+	stack_block * block;
+
+	spin_lock(&stack_lock);
+	block = cache_head;
+	if(block != NULL)
+	{
+		cache_head = block->free_next;
+		cache_stats.cached--;
+		cache_stats.hits++;
+	}
+	else
+		cache_stats.misses++;
+	spin_unlock(&stack_lock);
+
+	return block;
+}
+
+/** @brief Takes a block off the cache, or maps a fresh one
+ *
+ *  The block is not bound to any thread; its owner is whoever
+ *  the caller makes it.
+ *
+ *  @return The block, or NULL if no block could be mapped
+ */
+stack_block * thr_stack_get(void)
+{
+	stack_block * block = cache_pop();
+
+	if(block == NULL && (block = block_map(stack_lazy)) == NULL)
+		return NULL;
+
+	block->owner = NULL;
+	block->done = 0;
+	block->free_next = NULL;
+	return block;
+}
+
+/** @brief Maps pages of a lazy block down to address low
+ *
+ *  Pages go in one at a time, the way the fault handler would have
+ *  mapped them, so the block is released the same way either way.
+ *
+ *  @return SUCCESS, or ERROR if the kernel ran out of pages
+ */
+static int block_commit(stack_block *block, unsigned int low)
+{
+	void *page;
+
+	while(block->stack.low > low)
+	{
+		page = (void *)(block->stack.low - PAGE_SIZE);
+		if(new_pages(page, PAGE_SIZE) < 0)
+			return ERROR;
+		block->stack.low -= PAGE_SIZE;
+	}
+	return SUCCESS;
+}
+
+/** @brief Gets a block with just size bytes of stack committed
+ *
+ *  For small stacks that are switched to rather than run by a
+ *  thread of their own, and so have no fault handler to grow
+ *  them: the rest of the block stays unmapped as a guard. A fresh
+ *  block is marked lazy, so once released it can still serve as
+ *  the stack of a new thread, which will grow it on demand.
+ *
+ *  @return The block, or NULL if it could not be mapped
+ */
+stack_block * thr_stack_get_small(unsigned int size)
+{
+	stack_block * block = cache_pop();
+	unsigned int top, low;
+
+	if(block == NULL && (block = block_map(1)) == NULL)
+		return NULL;
+
+	top = (unsigned int)BLOCK_STACK_TOP(block);
+	low = block->stack.limit;
+	if(size < top - low)
+		low = (top - size) & ~(PAGE_SIZE - 1);
+	if(block_commit(block, low) < 0)
+	{
+		thr_stack_free(block);
+		return NULL;
+	}
+
+	block->owner = NULL;
+	block->done = 0;
+	block->free_next = NULL;
+	return block;
+}
+
+/** @brief Allocates a thread block for a new thread
+ *
+ *  A cached block is preferred over a fresh one.
+ *
+ *  @param name TCB of the thread that will run on the block
+ *  @return SUCCESS, or ERROR if no block could be mapped
+ */
+int thr_stack_alloc(tcb name)
+{
+	stack_block * block = thr_stack_get();
+
+	if(block == NULL)
+		return ERROR;
+
+	block_bind(block, name);
+	return SUCCESS;
+}
+
+/** @brief Allocates blocks for a list of new threads at once
+ *
+ *  All cached blocks needed are taken under a single acquisition
+ *  of the stack lock; only the shortfall is mapped afresh. Either
+ *  every thread gets a block or none does.
+ *
+ *  @param names TCBs linked through free_next
+ *  @return SUCCESS, or ERROR if not every block could be mapped
+ */
+int thr_stack_alloc_n(tcb names)
+{
+	stack_block * cached = NULL;
+	stack_block * block;
+	unsigned int want = 0;
+	tcb name;
+
+	for(name = names; name != NULL; name = name->free_next)
+		want++;
+
+	spin_lock(&stack_lock);
+	while(want > 0 && cache_head != NULL)
+	{
+		block = cache_head;
+		cache_head = block->free_next;
+		block->free_next = cached;
+		cached = block;
+		cache_stats.cached--;
+		cache_stats.hits++;
+		want--;
+	}
+	cache_stats.misses += want;
+	spin_unlock(&stack_lock);
+
+	for(name = names; name != NULL; name = name->free_next)
+	{
+		if(cached != NULL)
+		{
+			block = cached;
+			cached = block->free_next;
+		}
+		else if((block = block_map(stack_lazy)) == NULL)
+			break;
+
+		block_bind(block, name);
+	}
+
+	if(name == NULL)
+		return SUCCESS;
+
+	/* Undo: every thread before name got a block, nobody after */
+	while(names != name)
+	{
+		thr_stack_free(names->block);
+		names = names->free_next;
+	}
+	while(cached != NULL)
+	{
+		block = cached;
+		cached = block->free_next;
+		thr_stack_free(block);
+	}
+	return ERROR;
+}
+
+/** @brief Releases a block nobody is running on any more
+ *
+ *  The block goes back to the cache unless it is full, in which
+ *  case its pages are returned to the kernel.
+ */
+void thr_stack_free(stack_block *block)
+{
+	spin_lock(&stack_lock);
+	if(cache_stats.cached < cache_limit)
+	{
+		block->free_next = cache_head;
+		cache_head = block;
+		cache_stats.cached++;
+		block = NULL;
+	}
+	else
+		cache_stats.evictions++;
+	spin_unlock(&stack_lock);
+
+	if(block != NULL)
+		block_unmap(block);
+}
+
+/** @brief Queues the calling thread's block for reclamation
+ *
+ *  The block may not be reused until its done flag is set, which
+ *  the thread does on its way into vanish().
+ */
+void thr_stack_zombie(stack_block *block)
+{
+	spin_lock(&stack_lock);
+	block->free_next = zombie_head;
+	zombie_head = block;
+	spin_unlock(&stack_lock);
+}
+
+/** @brief Reclaims the blocks of threads that have finished exiting
+ *
+ *  The whole zombie queue is taken in one go; blocks whose thread
+ *  is still on its way out are put back for the next pass.
+ */
+void thr_stack_reap(void)
+{
+	stack_block * block;
+	stack_block * next;
+	stack_block * busy = NULL;
+
+	if(zombie_head == NULL)
+		return;
+
+	spin_lock(&stack_lock);
+	block = zombie_head;
+	zombie_head = NULL;
+	spin_unlock(&stack_lock);
+
+	for(; block != NULL; block = next)
+	{
+		next = block->free_next;
+		if(block->done)
+			thr_stack_free(block);
+		else
+		{
+			block->free_next = busy;
+			busy = block;
+		}
+	}
+
+	while(busy != NULL)
+	{
+		next = busy->free_next;
+		thr_stack_zombie(busy);
+		busy = next;
+	}
+}
+
+/** @brief Lets a new thread grow into a lazily committed block
+ *
+ *  Called by the thread itself, since fault handlers are per
+ *  thread. If the kernel will not take a handler, the rest of the
+ *  block is committed up front instead.
+ */
+void thr_stack_attach(stack_block *block)
+{
+	if(!block->lazy || autostack_attach(&block->stack) == 0)
+		return;
+
+	thr_stack_commit(block);
+}
+
+/** @brief Maps whatever part of a lazy block is not mapped yet
+ *
+ *  For stacks that must never fault, such as the ones user-level
+ *  threads switch onto.
+ *
+ *  @return SUCCESS, or ERROR if the kernel ran out of pages
+ */
+int thr_stack_commit(stack_block *block)
+{
+	return block_commit(block, block->stack.limit);
+}
+
+/** @brief Chooses whether new thread stacks are committed on demand
+ *
+ *  Stacks already mapped, including cached ones, keep the way
+ *  they were committed.
+ *
+ *  @param enable Nonzero to map only the top page of new stacks
+ */
+void thr_stack_lazy(int enable)
+{
+	stack_lazy = enable;
+}
+
+/** @brief Sets how many released stacks are kept for reuse
+ *
+ *  Lowering the limit trims the cache down to it right away.
+ *
+ *  @param limit High-water mark, 0 disables the cache
+ */
+void thr_stack_cache_limit(unsigned int limit)
+{
+	stack_block * trim = NULL;
+	stack_block * next;
+
+	spin_lock(&stack_lock);
+	cache_limit = limit;
+	while(cache_stats.cached > cache_limit)
+	{
+		next = cache_head;
+		cache_head = next->free_next;
+		next->free_next = trim;
+		trim = next;
+		cache_stats.cached--;
+		cache_stats.evictions++;
+	}
+	spin_unlock(&stack_lock);
+
+	while(trim != NULL)
+	{
+		next = trim->free_next;
+		block_unmap(trim);
+		trim = next;
+	}
+}
+
+/** @brief Copies out the stack cache counters */
+void thr_stack_cache_stats(thr_stack_cache_stats_t *stats)
+{
+	spin_lock(&stack_lock);
+	*stats = cache_stats;
+	spin_unlock(&stack_lock);
+}
+
+/** @brief Returns the TCB of the calling thread
+ *
+ *  @return Current TCB, or NULL before thr_init()
+ */
+tcb thr_self(void)
+{
+	unsigned int esp;
+
+	__asm__ volatile ("movl %%esp, %0" : "=r" (esp));
+
+	if(esp >= stack_region_top)
+		return root_tcb;
+
+	return BLOCK_FROM_SP(esp) -> owner;
+}
@@ -10,6 +10,9 @@
  *  4. thr_exit()
  *  5. thr_getid()
  *  6. thr_yield()
+ *  7. thr_create_detached()
+ *  8. thr_detach()
+ *  9. thr_create_n()
  *	
  *	@author Ishant & Shelton
  *
@@ -18,11 +21,33 @@
 
 #include<thr_internals.h>
 #include "thr_private.h"
+#include "atomic.h"
 #include <thread.h>
 #include<syscall.h>
 #include<stdlib.h>
 #include<simics.h>
 
+/** @brief Stack size requested in thr_init() */
+unsigned int stack_size;
+
+/** @brief Next library thread id to hand out */
+static int next_tid = 1;
+
+/** @brief Atomically sets bits in a thread's state word
+ *
+ *  @return The state before the bits were set
+ */
+static int set_state_bits(tcb name, int bits)
+{
+	int old;
+
+	do
+		old = name -> state;
+	while(atomic_cmpxchg(&name -> state, old, old | bits) != old);
+
+	return old;
+}
+
 
 int thr_init(unsigned int size)
 {
@@ -32,22 +57,21 @@ int thr_init(unsigned int size)
 	if ((size % WORD_SIZE)==0)
 	{
 		stack_size = size;
-		flag = SUCCESS;
+		flag = thr_stack_init(size);
 	}
 
 	else
 		flag = ERROR;
 
 	/* Allocate parent TCB */
-	void * tcb_mem = _calloc(1,TCB_SIZE);
+	tcb name = tcb_alloc();
+	if (name == NULL)
+		return ERROR;
 
-	tcb name = (tcb) tcb_mem;
-	/* EDIT: name-> sp, name->func, name->arg and name->waiter to be decided */
 	name->kid = gettid();
-	name->tid = name->kid;
-	name->waiter = -1;
-	name->children = NULL;
-	insert_tcb_list(name);
+	name->tid = atomic_xadd(&next_tid, 1);
+	root_tcb = name;
+	tcb_registry_insert_tid(name);
 	return flag;
 }
 
@@ -57,7 +81,10 @@ int thr_init(unsigned int size)
  *  and uses thread_fork system call to issue a new 
  *  task thread 
  *
- *  1. Currently using TID same as Kernel Issued ID
+ *  The library tid is handed out and registered before the
+ *  fork so the parent can join on it as soon as we return. The
+ *  child records its own kernel id, since others may need it to
+ *  wake the child before the parent is scheduled again.
  *  
  *  @param func  function pointer 
  *  @param arg Argument pointer 
@@ -66,223 +93,299 @@ int thr_init(unsigned int size)
  */
 typedef void *(*func)(void*) ;
 
-int thr_create( func handler, void * arg )
+/** @brief First code run by a new thread
+ *
+ *  The child comes out of thread_fork() with a frame pointer that
+ *  does not belong to it, so it must not touch thr_create()'s
+ *  locals; everything it needs is found through its own TCB.
+ */
+static void thr_child_start(void)
+{
+	tcb name = thr_self();
+
+	name->kid = gettid();
+	thr_stack_attach(name->block);
+	thr_exit(name->func(name->arg));
+}
+
+/** @brief Starts the kernel thread for a fully prepared TCB
+ *
+ *  If the fork fails the TCB and its stack are released.
+ *
+ *  @return 0, or THREAD_NOT_CREATED
+ */
+static int thr_launch( tcb name )
 {
-	/* Create stack for the thread */
-	/*EDIT: Replace 1 with macro */
-	
-	void * stack_tcb_mem = _calloc(1,(stack_size + TCB_SIZE + STACK_BUFFER));
-
-	/* TCB done */
-	register tcb name = (tcb) stack_tcb_mem;
-	name->sp = (void*)((unsigned int)stack_tcb_mem + stack_size + TCB_SIZE);
-	name->func = handler;
-	name->arg = arg;
-	name->waiter = -1;
-	tcb current = get_tcb_from_kid(gettid());
-	print_tcb_list();
-	push_children(&(current -> children),name);
 	/*Create kernel thread */
 	int pid = thread_fork(name->sp);
 	/* If child call the handler */
 	if (!pid)
+		thr_child_start();
+
+	if (pid < 0)
 	{
-		int tid = (int)name->func(name->arg);
-		thr_exit((void *)tid);
+		tcb_registry_remove(name);
+		thr_stack_free(name->block);
+		tcb_free(name);
+		return THREAD_NOT_CREATED;
 	}
 
-	name->kid = pid;
-	name->tid = pid;
-	insert_tcb_list(name);
-	print_tcb_list();
-	return pid;
+	return 0;
 }
 
-void print_tcb_list()
+/** @brief Creates a thread with the given initial state bits
+ *
+ *  The parent must not touch the new TCB once the child may run:
+ *  a detached child frees it as soon as it exits.
+ */
+static int thr_spawn( func handler, void * arg, int state )
 {
-	tcb temp = tcb_head;
-	while(temp != NULL)
-	{
-		lprintf("TCB: %p Kid: %d Tid: %d",temp,temp->tid,temp->kid);
-		temp = temp->next;
-	}
-}
+	int tid;
 
-int thr_join( int tid, void **statusp)
-{
-	int reject = 0;
-	tcb child = get_tcb_from_tid(tid);
+	/* Reclaim the stacks of threads that have exited */
+	thr_stack_reap();
 
-	if(child == NULL)
+	tcb name = tcb_alloc();
+
+	if (name == NULL)
 		return THREAD_NOT_CREATED;
 
-	if(isDone(child))
+	if (thr_stack_alloc(name) < 0)
 	{
-		if(statusp != NULL)
-		 *statusp = child -> exit_status;
-		remove_tcb_from_list(child);
-		_free(child);
-		return 0;
+		tcb_free(name);
+		return THREAD_NOT_CREATED;
 	}
 
-	else
-	{
-		child -> waiter = gettid();
+	name->func = handler;
+	name->arg = arg;
+	name->state = state;
+	name->tid = tid = atomic_xadd(&next_tid, 1);
+	tcb_registry_insert_tid(name);
 
-		if(deschedule(&reject) < 0)
-			lprintf("Cannot reschdule parent!\n");
+	if (thr_launch(name) < 0)
+		return THREAD_NOT_CREATED;
 
-		if(statusp != NULL)
-		 *statusp = child -> exit_status;
-		remove_tcb_from_list(child);
-		_free(child);
-		return 0;
+	return tid;
+}
 
-	}
+int thr_create( func handler, void * arg )
+{
+	return thr_spawn(handler, arg, 0);
+}
 
+/** @brief Creates a thread nobody joins
+ *
+ *  Its TCB and stack are reclaimed as soon as it exits.
+ */
+int thr_create_detached( func handler, void * arg )
+{
+	return thr_spawn(handler, arg, THR_DETACHED);
 }
 
-void thr_exit( void *status )
+/** @brief Creates n joinable threads running handler
+ *
+ *  Thread i runs handler(args[i]), or handler(NULL) if args is
+ *  NULL. TCBs and stacks for the whole batch are allocated up
+ *  front, each allocator's lock taken once, and the tids are
+ *  reserved with a single atomic add, so only the forks
+ *  themselves are paid per thread.
+ *
+ *  If a fork fails, the threads not yet started are torn down
+ *  and their tids[] entries set to THREAD_NOT_CREATED; the
+ *  threads already running are left alone.
+ *
+ *  @param tids Receives the n thread ids
+ *  @return Number of threads created, THREAD_NOT_CREATED if
+ *          nothing could be allocated
+ */
+int thr_create_n( func handler, void ** args, int n, int * tids )
 {
-	tcb current = get_tcb_from_kid(gettid());
+	tcb names, name, next;
+	int first, i, created;
 
-	current -> exit_status = status;
+	if (n <= 0 || tids == NULL)
+		return THREAD_NOT_CREATED;
+
+	/* Reclaim the stacks of threads that have exited */
+	thr_stack_reap();
 
-	if(current -> waiter != -1)
+	names = tcb_alloc_n(n);
+	if (names == NULL)
+		return THREAD_NOT_CREATED;
+
+	if (thr_stack_alloc_n(names) < 0)
 	{
-		if(make_runnable(current -> waiter) < 0)
-			lprintf("Cannot run parent again\n");
+		for (name = names; name != NULL; name = next)
+		{
+			next = name->free_next;
+			tcb_free(name);
+		}
+		return THREAD_NOT_CREATED;
 	}
 
-	else
-		setDone(current);
+	first = atomic_xadd(&next_tid, n);
+	for (name = names, i = 0; name != NULL; name = name->free_next, i++)
+	{
+		name->func = handler;
+		name->arg = args != NULL ? args[i] : NULL;
+		name->tid = tids[i] = first + i;
+		tcb_registry_insert_tid(name);
+	}
 
-	vanish();
-}
+	/* free_next is ours until the thread runs, so read it first */
+	for (name = names, i = 0; name != NULL; name = next, i++)
+	{
+		next = name->free_next;
+		name->free_next = NULL;
+		if (thr_launch(name) < 0)
+			break;
+	}
 
-int thr_yield( int tid )
-{
-	if(tid == -1)
-		yield(tid);
-	else
+	if (name == NULL)
+		return n;
+
+	/* name has been released by thr_launch(), undo the rest */
+	created = i;
+	tids[i] = THREAD_NOT_CREATED;
+	for (name = next, i++; name != NULL; name = next, i++)
 	{
-		tcb thread_yield = get_tcb_from_tid(tid);
-		if(thread_yield == NULL)
-			return THREAD_NOT_CREATED;
-		if (yield(thread_yield -> kid) < 0)
-			return THREAD_NOT_CREATED;
+		next = name->free_next;
+		tids[i] = THREAD_NOT_CREATED;
+		tcb_registry_remove(name);
+		thr_stack_free(name->block);
+		tcb_free(name);
 	}
 
-	return 0;
+	return created;
 }
 
-int thr_getid( void )
+/** @brief Lets a thread's resources go without joining it
+ *
+ *  @return 0, or THREAD_NOT_CREATED if tid does not exist, is
+ *          already detached or is being joined
+ */
+int thr_detach( int tid )
 {
-	int kid = gettid();
-	tcb current = get_tcb_from_kid(kid);
-	return current -> tid;
-}
+	tcb child = get_tcb_from_tid(tid);
+	int old;
 
-void insert_tcb_list(tcb entry)
-{
-	tcb temp = tcb_head;
-	tcb_head = entry;
-	entry-> next = temp;
-}
+	if(child == NULL)
+		return THREAD_NOT_CREATED;
 
-void remove_tcb_from_list(tcb entry)
-{
-	tcb temp = tcb_head;
-	tcb prev = NULL;
-	while(temp != entry && temp)
+	do
 	{
-		prev = temp;
-		temp = temp ->next;
+		old = child -> state;
+		if(old & (THR_DETACHED | THR_JOINED))
+			return THREAD_NOT_CREATED;
 	}
+	while(atomic_cmpxchg(&child -> state, old, old | THR_DETACHED) != old);
 
-	if(prev)
-		prev -> next = temp;
-	else
-		tcb_head = temp -> next;
-		
-}
-
-tcb get_tcb_from_tid(int pid)
-{
-	tcb temp = tcb_head;
-	while(temp != NULL)
+	/* Already gone, so nobody else will free it */
+	if(old & THR_EXITED)
 	{
-
-		if(temp -> tid == pid)
-			return temp;
-
-		else
-			temp = temp -> next;
+		tcb_registry_remove(child);
+		tcb_free(child);
 	}
 
-	return TCB_NOT_FOUND;
+	return 0;
 }
 
-tcb get_tcb_from_kid(int kid)
+/** @brief Waits for a thread to exit and collects its status
+ *
+ *  The joiner claims the child by installing its own TCB in the
+ *  child's state word. If the child had not exited yet, the child
+ *  will set our wake flag and make us runnable on its way out;
+ *  deschedule() rejects the sleep if the flag is already set, so
+ *  the wakeup cannot be lost however the two race.
+ *
+ *  @return 0, or THREAD_NOT_CREATED if tid does not exist, is
+ *          detached or already has a joiner
+ */
+int thr_join( int tid, void **statusp)
 {
-	tcb temp = tcb_head;
-	while(temp != NULL)
-	{
+	tcb self = thr_self();
+	tcb child = get_tcb_from_tid(tid);
+	int old;
 
-		if(temp -> kid == kid)
-			return temp;
+	if(child == NULL || child == self)
+		return THREAD_NOT_CREATED;
 
-		else
-			temp = temp -> next;
+	thr_park_prepare(self);
+	do
+	{
+		old = child -> state;
+		if(old & (THR_DETACHED | THR_JOINED))
+			return THREAD_NOT_CREATED;
 	}
+	while(atomic_cmpxchg(&child -> state, old,
+	                     old | THR_JOINED | (int)self) != old);
 
-	return TCB_NOT_FOUND;
-}
+	if(!(old & THR_EXITED))
+		thr_park(self);
 
-void push_children(children_list **head,tcb child)
-{
-	children_list *tl = _calloc(1,sizeof(children_list));
-	tl -> next = *head;
-	tl -> name = child;
-	*head = tl;
+	if(statusp != NULL)
+	 *statusp = child -> exit_status;
+	tcb_registry_remove(child);
+	tcb_free(child);
+	thr_stack_reap();
+	return 0;
 }
 
-/*void remove_children(children_list **head,tcb child)
+/** @brief Ends the calling thread
+ *
+ *  Once the exited bit is set the TCB belongs to the joiner, or
+ *  to nobody if we are detached, so it is not touched again.
+ */
+void thr_exit( void *status )
 {
-	children_list *temp = *head;
-	children_list *prev = NULL;
-	while(temp -> name != child && temp)
+	tcb current = thr_self();
+	stack_block * block = current -> block;
+	int old;
+
+	tls_run_destructors(current);
+	current -> exit_status = status;
+
+	/* Our stack is reclaimed by someone else once we are gone */
+	if(block != NULL)
+		thr_stack_zombie(block);
+
+	old = set_state_bits(current, THR_EXITED);
+
+	if(old & THR_DETACHED)
 	{
-		prev = temp;
-		temp = temp -> next;
+		/* Nobody will join us, so nobody needs our TCB */
+		tcb_registry_remove(current);
+		tcb_free(current);
 	}
 
-	if(prev)
-		prev -> next = temp;
-	else
-		*head = NULL;
-
-	free_child_thread_list(temp);
-}*/
+	else if(old & THR_JOINED)
+		thr_unpark(THR_JOINER(old));
 
+	if(block == NULL)
+		vanish();
+	thread_vanish(&block -> done);
+}
 
-void free_child_thread_list(children_list * head)
+int thr_yield( int tid )
 {
-	children_list * next;
-	while(head)
+	if(tid == -1)
+		yield(tid);
+	else
 	{
-		next = head -> next;
-		_free(head);
-		head = next;
+		tcb thread_yield = get_tcb_from_tid(tid);
+		if(thread_yield == NULL)
+			return THREAD_NOT_CREATED;
+		/* Not running yet, it only needs the CPU */
+		if(thread_yield -> kid == 0)
+			yield(-1);
+		else if (yield(thread_yield -> kid) < 0)
+			return THREAD_NOT_CREATED;
 	}
+
+	return 0;
 }
 
-void freeThread(tcb thread)
+int thr_getid( void )
 {
-	if (thread->waiter != -1) {
-    lprintf("Thread %p exits while waiting on something\n", thread);
-  }
-
-  free_child_thread_list(thread->children);
-  _free(thread);
+	return thr_self() -> tid;
 }
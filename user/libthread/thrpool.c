@@ -0,0 +1,295 @@
+/** @file thrpool.c
+ *
+ *  @brief Fixed-size pool of worker threads
+ *
+ *  Tasks go into a bounded ring under the pool's spinlock and are
+ *  taken out by the workers in submission order. A worker that
+ *  finds the ring empty parks itself on the idle list, and the
+ *  next submit wakes exactly one of them; a submitter that finds
+ *  the ring full parks until a worker takes a task out. Idle
+ *  workers are woken last in, first out, so the one whose stack
+ *  is still warm gets the work.
+ *
+ *  Every parked thread is chained through the wait_next link of
+ *  its own TCB, so nothing is allocated once the pool is up.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug A task that submits to its own pool can block forever
+ *       if the ring is full and every worker does the same.
+ */
+
+#include <thr_internals.h>
+#include <thrpool.h>
+#include <thread.h>
+#include <stdlib.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief One queued task */
+typedef struct thrpool_task {
+  void *(*func)(void *);
+  void *arg;
+} thrpool_task_t;
+
+struct thrpool {
+  spinlock_t lock;
+
+  /* Ring of queued tasks */
+  thrpool_task_t *queue;
+  int qsize;
+  int head;
+  int count;
+
+  /* Tasks submitted and not yet finished */
+  int pending;
+  int shutdown;
+
+  /* Parked threads, linked through wait_next */
+  tcb idle;
+  tcb full;
+  tcb waiters;
+
+  int nworkers;
+  int *tids;
+};
+
+/** @brief Wakes every thread on a list taken off the pool */
+static void wake_all(tcb list)
+{
+	tcb next;
+
+	for(; list != NULL; list = next)
+	{
+		/* The thread may be gone once it is unparked */
+		next = list -> wait_next;
+		thr_unpark(list);
+	}
+}
+
+/** @brief Parks the caller on *list, with the pool lock held
+ *
+ *  The lock is dropped while we sleep and held again on return.
+ */
+static void pool_park(thrpool_t *pool, tcb *list)
+{
+	tcb self = thr_self();
+
+	thr_park_prepare(self);
+	self -> wait_next = *list;
+	*list = self;
+	spin_unlock(&pool -> lock);
+	thr_park(self);
+	spin_lock(&pool -> lock);
+}
+
+/** @brief Body of every worker thread
+ *
+ *  Runs tasks until the pool is shut down and its ring drained.
+ */
+static void *thrpool_worker(void *arg)
+{
+	thrpool_t *pool = arg;
+	thrpool_task_t task;
+	tcb submitter, waiters;
+
+	spin_lock(&pool -> lock);
+	for(;;)
+	{
+		while(pool -> count == 0 && !pool -> shutdown)
+			pool_park(pool, &pool -> idle);
+
+		if(pool -> count == 0)
+			break;
+
+		task = pool -> queue[pool -> head];
+		pool -> head = (pool -> head + 1) % pool -> qsize;
+		pool -> count--;
+
+		/* There is a free slot now */
+		submitter = pool -> full;
+		if(submitter != NULL)
+			pool -> full = submitter -> wait_next;
+		spin_unlock(&pool -> lock);
+
+		if(submitter != NULL)
+			thr_unpark(submitter);
+
+		task.func(task.arg);
+
+		spin_lock(&pool -> lock);
+		if(--pool -> pending == 0 && pool -> waiters != NULL)
+		{
+			waiters = pool -> waiters;
+			pool -> waiters = NULL;
+			spin_unlock(&pool -> lock);
+			wake_all(waiters);
+			spin_lock(&pool -> lock);
+		}
+	}
+	spin_unlock(&pool -> lock);
+
+	return NULL;
+}
+
+/** @brief Creates a pool of worker threads
+ *
+ *  @param nworkers Number of worker threads
+ *  @param qsize Number of tasks that can be queued at once
+ *  @return The pool, or NULL if it could not be created
+ *
+ *  @pre thr_init should have been called
+ */
+thrpool_t *thrpool_create(int nworkers, int qsize)
+{
+	thrpool_t *pool;
+	void **args;
+	int i;
+
+	if(nworkers <= 0 || qsize <= 0)
+		return NULL;
+
+	pool = calloc(1, sizeof(thrpool_t));
+	if(pool == NULL)
+		return NULL;
+
+	pool -> queue = malloc(qsize * sizeof(thrpool_task_t));
+	pool -> tids = malloc(nworkers * sizeof(int));
+	args = malloc(nworkers * sizeof(void *));
+	if(pool -> queue == NULL || pool -> tids == NULL || args == NULL)
+	{
+		free(args);
+		free(pool -> tids);
+		free(pool -> queue);
+		free(pool);
+		return NULL;
+	}
+
+	spin_init(&pool -> lock);
+	pool -> qsize = qsize;
+	for(i = 0; i < nworkers; i++)
+		args[i] = pool;
+
+	pool -> nworkers = thr_create_n(thrpool_worker, args, nworkers,
+	                                pool -> tids);
+	free(args);
+
+	if(pool -> nworkers < nworkers)
+	{
+		/* Let whatever workers did start go again */
+		if(pool -> nworkers < 0)
+			pool -> nworkers = 0;
+		thrpool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/** @brief Queues func(arg) to run on one of the workers
+ *
+ *  Blocks while the queue is full.
+ *
+ *  @return 0, or ERROR if the pool is being destroyed
+ */
+int thrpool_submit(thrpool_t *pool, void *(*func)(void *), void *arg)
+{
+	tcb worker;
+	int tail;
+
+	if(pool == NULL || func == NULL)
+		return ERROR;
+
+	spin_lock(&pool -> lock);
+	while(pool -> count == pool -> qsize && !pool -> shutdown)
+		pool_park(pool, &pool -> full);
+
+	if(pool -> shutdown)
+	{
+		spin_unlock(&pool -> lock);
+		return ERROR;
+	}
+
+	tail = (pool -> head + pool -> count) % pool -> qsize;
+	pool -> queue[tail].func = func;
+	pool -> queue[tail].arg = arg;
+	pool -> count++;
+	pool -> pending++;
+
+	worker = pool -> idle;
+	if(worker != NULL)
+		pool -> idle = worker -> wait_next;
+	spin_unlock(&pool -> lock);
+
+	if(worker != NULL)
+		thr_unpark(worker);
+
+	return SUCCESS;
+}
+
+/** @brief Waits until every task submitted so far has finished
+ *
+ *  Must not be called from one of the pool's own tasks.
+ *
+ *  @return 0, or ERROR if pool is NULL
+ */
+int thrpool_wait(thrpool_t *pool)
+{
+	if(pool == NULL)
+		return ERROR;
+
+	spin_lock(&pool -> lock);
+	while(pool -> pending > 0)
+		pool_park(pool, &pool -> waiters);
+	spin_unlock(&pool -> lock);
+
+	return SUCCESS;
+}
+
+/** @brief Number of worker threads in the pool
+ *
+ *  @return The count, or ERROR if pool is NULL
+ */
+int thrpool_size(thrpool_t *pool)
+{
+	if(pool == NULL)
+		return ERROR;
+
+	return pool -> nworkers;
+}
+
+/** @brief Runs the queued tasks, stops the workers and frees the pool
+ *
+ *  Submitters still blocked on a full queue fail with ERROR.
+ *
+ *  @return 0, or ERROR if pool is NULL
+ *
+ *  @pre No thread uses pool once this returns
+ */
+int thrpool_destroy(thrpool_t *pool)
+{
+	tcb idle, full;
+	int i;
+
+	if(pool == NULL)
+		return ERROR;
+
+	spin_lock(&pool -> lock);
+	pool -> shutdown = 1;
+	idle = pool -> idle;
+	full = pool -> full;
+	pool -> idle = NULL;
+	pool -> full = NULL;
+	spin_unlock(&pool -> lock);
+
+	wake_all(idle);
+	wake_all(full);
+
+	for(i = 0; i < pool -> nworkers; i++)
+		thr_join(pool -> tids[i], NULL);
+
+	free(pool -> tids);
+	free(pool -> queue);
+	free(pool);
+	return SUCCESS;
+}
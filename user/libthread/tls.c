@@ -0,0 +1,103 @@
+/** @file tls.c
+ *
+ *  @brief Thread-local storage
+ *
+ *  Keys are handed out from an atomic counter and never reused, so
+ *  a key is valid in every thread from the moment it exists and a
+ *  slot can never hold a value set under some older key. Slot i of
+ *  the calling thread is thr_self() -> tls[i].
+ *
+ *  When a thread exits, every non-NULL slot with a destructor is
+ *  cleared and its old value handed to the destructor. Destructors
+ *  may set slots again, so this is repeated a few times, as POSIX
+ *  does, before the rest is left behind.
+ *
+ *  @author Ishant & Shelton
+ *
+ *  @bug No known bugs
+ */
+
+#include <thr_internals.h>
+#include <tls.h>
+#include <stddef.h>
+#include "thr_private.h"
+#include "atomic.h"
+
+/** @brief Rounds of destructors run at thread exit */
+#define TLS_DESTRUCTOR_ROUNDS 4
+
+/** @brief Number of keys handed out so far, may overshoot TLS_KEYS */
+static volatile int tls_next_key;
+
+static void (*tls_destructors[TLS_KEYS])(void *);
+
+/** @brief Creates a key
+ *
+ *  @param destructor Called on a thread's non-NULL value when it
+ *         exits, or NULL
+ *  @return 0, or ERROR if every key is in use
+ */
+int key_create(tls_key_t *key, void (*destructor)(void *))
+{
+	int k;
+
+	if(key == NULL)
+		return ERROR;
+
+	k = atomic_xadd(&tls_next_key, 1);
+	if(k >= TLS_KEYS)
+		return ERROR;
+
+	tls_destructors[k] = destructor;
+	*key = k;
+	return SUCCESS;
+}
+
+/** @brief Reads the calling thread's value for key
+ *
+ *  @return The value, NULL if none was set or key is invalid
+ */
+void *tls_get(tls_key_t key)
+{
+	if(key < 0 || key >= TLS_KEYS)
+		return NULL;
+
+	return thr_self() -> tls[key];
+}
+
+/** @brief Sets the calling thread's value for key
+ *
+ *  @return 0, or ERROR if key is invalid
+ */
+int tls_set(tls_key_t key, void *value)
+{
+	if(key < 0 || key >= TLS_KEYS || key >= tls_next_key)
+		return ERROR;
+
+	thr_self() -> tls[key] = value;
+	return SUCCESS;
+}
+
+void tls_run_destructors(tcb self)
+{
+	void *value;
+	int round, k, ran;
+
+	for(round = 0; round < TLS_DESTRUCTOR_ROUNDS; round++)
+	{
+		ran = 0;
+		for(k = 0; k < TLS_KEYS; k++)
+		{
+			value = self -> tls[k];
+			if(value == NULL || tls_destructors[k] == NULL)
+				continue;
+
+			self -> tls[k] = NULL;
+			tls_destructors[k](value);
+			ran = 1;
+		}
+
+		if(!ran)
+			break;
+	}
+}
@@ -0,0 +1,87 @@
+/** @file create_n_bench.c
+ *
+ *  @brief Compares the spawn rate of thr_create_n() against the
+ *         same number of thr_create() calls
+ *
+ *  Only the spawning is timed; the threads are joined afterwards,
+ *  outside the measurement, before the next round starts.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <thread_ext.h>
+#include <syscall.h>
+
+#define NSIZES 3
+static const int sizes[NSIZES] = { 10, 100, 1000 };
+
+static void *quit(void *arg)
+{
+	return arg;
+}
+
+static void join_all(int *tids, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+		thr_join(tids[i], NULL);
+}
+
+int main()
+{
+	int *tids;
+	int i, n, created;
+	unsigned int start, single, batch;
+
+	thr_init(4 * PAGE_SIZE);
+
+	n = sizes[NSIZES - 1];
+	tids = malloc(n * sizeof(int));
+	if(tids == NULL)
+	{
+		printf("create_n_bench: out of memory\n");
+		return -1;
+	}
+
+	for(i = 0; i < NSIZES; i++)
+	{
+		n = sizes[i];
+
+		start = get_ticks();
+		for(created = 0; created < n; created++)
+		{
+			tids[created] = thr_create(quit, NULL);
+			if(tids[created] < 0)
+				break;
+		}
+		single = get_ticks() - start;
+		join_all(tids, created);
+		if(created < n)
+		{
+			printf("thr_create failed after %d threads\n", created);
+			break;
+		}
+
+		start = get_ticks();
+		created = thr_create_n(quit, NULL, n, tids);
+		batch = get_ticks() - start;
+		if(created > 0)
+			join_all(tids, created);
+		if(created < n)
+		{
+			printf("thr_create_n created only %d of %d threads\n",
+			       created, n);
+			break;
+		}
+
+		printf("%4d threads: thr_create %u ticks, "
+		       "thr_create_n %u ticks\n", n, single, batch);
+	}
+
+	free(tids);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/** @file join_bench.c
+ *
+ *  @brief Times thr_join() against thousands of threads exiting
+ *         at once, and detached threads against joined ones
+ *
+ *  All threads of a round are created before any is joined, so
+ *  most of the joins race with the exit of the very thread being
+ *  joined, which is where the exit/join handshake is exercised.
+ *  The detached round times the same threads reclaimed with no
+ *  joiner at all.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <thread_ext.h>
+#include <mutex.h>
+#include <syscall.h>
+
+/** @brief Threads per round */
+#define NTHREADS 2000
+
+/** @brief Yields each thread makes before exiting */
+#define SPIN 4
+
+static mutex_t left_lock;
+static int left;
+
+static void *worker(void *arg)
+{
+	int i;
+
+	for(i = 0; i < SPIN; i++)
+		thr_yield(-1);
+	return arg;
+}
+
+static void *detached_worker(void *arg)
+{
+	worker(arg);
+
+	mutex_lock(&left_lock);
+	left--;
+	mutex_unlock(&left_lock);
+	return arg;
+}
+
+int main()
+{
+	int *tids;
+	int i, n, done;
+	unsigned int start, ticks;
+
+	thr_init(4 * PAGE_SIZE);
+	mutex_init(&left_lock);
+
+	tids = malloc(NTHREADS * sizeof(int));
+	if(tids == NULL)
+	{
+		printf("join_bench: out of memory\n");
+		return -1;
+	}
+
+	/* Joined: create them all, then join them in order */
+	for(n = 0; n < NTHREADS; n++)
+	{
+		tids[n] = thr_create(worker, (void *)n);
+		if(tids[n] < 0)
+			break;
+	}
+
+	start = get_ticks();
+	for(i = 0; i < n; i++)
+		thr_join(tids[i], NULL);
+	ticks = get_ticks() - start;
+	printf("joined:   %d threads, %u ticks to join them all\n", n, ticks);
+
+	/* Detached: nobody joins, wait until the last one has gone */
+	left = NTHREADS;
+	start = get_ticks();
+	for(n = 0; n < NTHREADS; n++)
+	{
+		if(thr_create_detached(detached_worker, NULL) < 0)
+			break;
+	}
+
+	mutex_lock(&left_lock);
+	left -= NTHREADS - n;
+	mutex_unlock(&left_lock);
+
+	do
+	{
+		thr_yield(-1);
+		mutex_lock(&left_lock);
+		done = (left == 0);
+		mutex_unlock(&left_lock);
+	}
+	while(!done);
+	ticks = get_ticks() - start;
+	printf("detached: %d threads, %u ticks to create and reclaim\n",
+	       n, ticks);
+
+	mutex_destroy(&left_lock);
+	free(tids);
+	return 0;
+}
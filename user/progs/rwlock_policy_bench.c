@@ -0,0 +1,173 @@
+/** @file rwlock_policy_bench.c
+ *
+ *  @brief Tail latency of readers and writers under each rwlock
+ *         policy
+ *
+ *  READERS readers and WRITERS writers share one lock under a
+ *  steady mixed load. Every acquisition records how long it waited,
+ *  in time-stamp counter cycles, into a power-of-two histogram; the
+ *  median, 99th percentile and worst case are then reported for
+ *  each side. Bounds are the top of the histogram bucket, so they
+ *  are good to within a factor of two.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <thread.h>
+#include <mutex.h>
+#include <rwlock.h>
+#include <syscall.h>
+
+#define READERS 8
+#define WRITERS 2
+#define READ_OPS 500
+#define WRITE_OPS 100
+
+/** @brief Loop iterations spent holding the lock */
+#define HOLD 50
+
+/** @brief One bucket per power of two of cycles */
+#define BUCKETS 32
+
+typedef struct hist {
+  unsigned int count[BUCKETS];
+} hist_t;
+
+static rwlock_t rw;
+static mutex_t merge_lock;
+static hist_t read_hist, write_hist;
+static volatile int shared;
+
+/** @brief Low word of the time-stamp counter, enough for one wait */
+static unsigned int cycles(void)
+{
+	unsigned int lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return lo;
+}
+
+static void record(hist_t *h, unsigned int waited)
+{
+	int b = 0;
+
+	while(b < BUCKETS - 1 && (waited >> (b + 1)) != 0)
+		b++;
+	h -> count[b]++;
+}
+
+/** @brief Adds a thread's histogram into the shared one */
+static void merge(hist_t *into, hist_t *from)
+{
+	int b;
+
+	mutex_lock(&merge_lock);
+	for(b = 0; b < BUCKETS; b++)
+		into -> count[b] += from -> count[b];
+	mutex_unlock(&merge_lock);
+}
+
+static void *worker(void *arg)
+{
+	int type = (int)arg;
+	int ops = type == RWLOCK_READ ? READ_OPS : WRITE_OPS;
+	hist_t mine;
+	unsigned int start;
+	int i, j;
+
+	for(i = 0; i < BUCKETS; i++)
+		mine.count[i] = 0;
+
+	for(i = 0; i < ops; i++)
+	{
+		start = cycles();
+		rwlock_lock(&rw, type);
+		record(&mine, cycles() - start);
+
+		for(j = 0; j < HOLD; j++)
+		{
+			if(type == RWLOCK_WRITE)
+				shared++;
+			else
+				(void)shared;
+		}
+		rwlock_unlock(&rw);
+
+		if(type == RWLOCK_WRITE || i % 8 == 0)
+			thr_yield(-1);
+	}
+
+	merge(type == RWLOCK_READ ? &read_hist : &write_hist, &mine);
+	return NULL;
+}
+
+/** @brief Upper bound in cycles of the pct-th percentile of h */
+static unsigned int percentile(hist_t *h, int pct)
+{
+	unsigned int total = 0, seen = 0;
+	int b;
+
+	for(b = 0; b < BUCKETS; b++)
+		total += h -> count[b];
+
+	for(b = 0; b < BUCKETS - 1; b++)
+	{
+		seen += h -> count[b];
+		if(seen * 100 >= total * pct)
+			break;
+	}
+	return b < BUCKETS - 1 ? 2u << b : 0xffffffffu;
+}
+
+static void report(const char *who, hist_t *h)
+{
+	printf("  %s: p50 < %u, p99 < %u, max < %u cycles\n", who,
+	       percentile(h, 50), percentile(h, 99), percentile(h, 100));
+}
+
+#define NPOLICIES 3
+static const int policies[NPOLICIES] = {
+	RWLOCK_PREFER_READERS, RWLOCK_PREFER_WRITERS, RWLOCK_PHASE_FAIR
+};
+static const char *names[NPOLICIES] = {
+	"reader-preferring", "writer-preferring", "phase-fair"
+};
+
+int main()
+{
+	int tids[READERS + WRITERS];
+	int i, p, n;
+
+	thr_init(4 * PAGE_SIZE);
+	mutex_init(&merge_lock);
+
+	for(p = 0; p < NPOLICIES; p++)
+	{
+		rwlock_init_policy(&rw, policies[p]);
+		for(i = 0; i < BUCKETS; i++)
+		{
+			read_hist.count[i] = 0;
+			write_hist.count[i] = 0;
+		}
+
+		/* Interleave the writers among the readers */
+		for(n = 0; n < READERS + WRITERS; n++)
+		{
+			tids[n] = thr_create(worker, (void *)(n % 5 == 2 ?
+			                     RWLOCK_WRITE : RWLOCK_READ));
+			if(tids[n] < 0)
+				break;
+		}
+		for(i = 0; i < n; i++)
+			thr_join(tids[i], NULL);
+
+		printf("%s:\n", names[p]);
+		report("readers", &read_hist);
+		report("writers", &write_hist);
+		rwlock_destroy(&rw);
+	}
+
+	mutex_destroy(&merge_lock);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/** @file rwlock_read_bench.c
+ *
+ *  @brief Read-heavy workload on an rwlock and on a mutex
+ *
+ *  Each reader takes the lock READS times to read a shared table;
+ *  one writer updates it WRITES times alongside. The same work is
+ *  then done with a mutex taken by everybody, to show what readers
+ *  gain by not serializing on each other.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <thread.h>
+#include <mutex.h>
+#include <rwlock.h>
+#include <syscall.h>
+
+#define READS 2000
+#define WRITES 20
+#define TABLE 16
+#define MAX_READERS 16
+
+#define NLEVELS 4
+static const int levels[NLEVELS] = { 1, 4, 8, MAX_READERS };
+
+static rwlock_t rw;
+static mutex_t mp;
+static int use_rwlock;
+static volatile int table[TABLE];
+
+static void lock(int type)
+{
+	if(use_rwlock)
+		rwlock_lock(&rw, type);
+	else
+		mutex_lock(&mp);
+}
+
+static void unlock(void)
+{
+	if(use_rwlock)
+		rwlock_unlock(&rw);
+	else
+		mutex_unlock(&mp);
+}
+
+static void *reader(void *arg)
+{
+	int i, j, sum = 0;
+
+	for(i = 0; i < READS; i++)
+	{
+		lock(RWLOCK_READ);
+		for(j = 0; j < TABLE; j++)
+			sum += table[j];
+		unlock();
+	}
+	return (void *)sum;
+}
+
+static void *writer(void *arg)
+{
+	int i, j;
+
+	for(i = 0; i < WRITES; i++)
+	{
+		lock(RWLOCK_WRITE);
+		for(j = 0; j < TABLE; j++)
+			table[j]++;
+		unlock();
+		thr_yield(-1);
+	}
+	return arg;
+}
+
+/** @brief Runs nreaders readers and the writer to completion
+ *
+ *  @return Ticks taken
+ */
+static unsigned int run(int nreaders)
+{
+	int tids[MAX_READERS + 1];
+	int i, n;
+	unsigned int start = get_ticks();
+
+	for(n = 0; n < nreaders; n++)
+	{
+		tids[n] = thr_create(reader, NULL);
+		if(tids[n] < 0)
+			break;
+	}
+	tids[n] = thr_create(writer, NULL);
+	if(tids[n] >= 0)
+		n++;
+
+	for(i = 0; i < n; i++)
+		thr_join(tids[i], NULL);
+
+	return get_ticks() - start;
+}
+
+int main()
+{
+	unsigned int rw_ticks, mutex_ticks;
+	int l;
+
+	thr_init(4 * PAGE_SIZE);
+	rwlock_init(&rw);
+	mutex_init(&mp);
+
+	for(l = 0; l < NLEVELS; l++)
+	{
+		use_rwlock = 1;
+		rw_ticks = run(levels[l]);
+		use_rwlock = 0;
+		mutex_ticks = run(levels[l]);
+
+		printf("%2d readers: rwlock %u ticks, mutex %u ticks\n",
+		       levels[l], rw_ticks, mutex_ticks);
+	}
+
+	rwlock_destroy(&rw);
+	mutex_destroy(&mp);
+	return 0;
+}
@@ -0,0 +1,68 @@
+/** @file sem_bench.c
+ *
+ *  @brief Throughput of sem_wait()/sem_signal() pairs at rising
+ *         contention
+ *
+ *  The semaphore admits SLOTS threads at a time. With no more
+ *  threads than slots every pair stays on the xadd fast path; past
+ *  that, more and more of them have to queue and park.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <thread.h>
+#include <sem.h>
+#include <syscall.h>
+
+#define SLOTS 4
+#define PAIRS 2000
+#define MAX_THREADS 24
+
+#define NLEVELS 5
+static const int levels[NLEVELS] = { 1, 4, 8, 16, MAX_THREADS };
+
+static sem_t sem;
+
+static void *hammer(void *arg)
+{
+	int i;
+
+	for(i = 0; i < PAIRS; i++)
+	{
+		sem_wait(&sem);
+		sem_signal(&sem);
+	}
+	return arg;
+}
+
+int main()
+{
+	int tids[MAX_THREADS];
+	int i, l, n;
+	unsigned int start, ticks;
+
+	thr_init(4 * PAGE_SIZE);
+
+	for(l = 0; l < NLEVELS; l++)
+	{
+		sem_init(&sem, SLOTS);
+
+		start = get_ticks();
+		for(n = 0; n < levels[l]; n++)
+		{
+			tids[n] = thr_create(hammer, NULL);
+			if(tids[n] < 0)
+				break;
+		}
+		for(i = 0; i < n; i++)
+			thr_join(tids[i], NULL);
+		ticks = get_ticks() - start;
+
+		printf("%2d threads on %d slots: %d pairs in %u ticks\n",
+		       n, SLOTS, n * PAIRS, ticks);
+		sem_destroy(&sem);
+	}
+
+	return 0;
+}
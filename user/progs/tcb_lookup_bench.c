@@ -0,0 +1,117 @@
+/** @file tcb_lookup_bench.c
+ *
+ *  @brief Times TCB registry lookups with 10 to 10,000 threads
+ *         registered
+ *
+ *  Each round starts n detached threads that block on a latch, so
+ *  all n stay registered while the lookups run. Hits are
+ *  thr_detach() calls on those threads: the lookup finds the TCB,
+ *  sees it is already detached and returns without entering the
+ *  kernel. Misses are thr_detach() calls on tids that land in the
+ *  same bucket as a registered thread but were never handed out,
+ *  so they walk the whole chain. With the registry growing along
+ *  with the thread count, both should stay flat across rounds.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <thread_ext.h>
+#include <latch.h>
+#include <syscall.h>
+
+/** @brief Lookups timed per round, for hits and for misses each */
+#define LOOKUPS 100000
+
+/** @brief Turns a tid into one that is never handed out but hashes
+ *         to the same bucket in any table up to 2^20 buckets */
+#define MISS_OFFSET (1 << 20)
+
+#define NSIZES 4
+static const int sizes[NSIZES] = { 10, 100, 1000, 10000 };
+
+/** @brief Opened once a round's lookups are done */
+static latch_t gate;
+
+/** @brief Counted down by each thread on its way out */
+static latch_t gone;
+
+static void *blocked(void *arg)
+{
+	latch_wait(&gate);
+	latch_count_down(&gone);
+	return arg;
+}
+
+/** @brief Times LOOKUPS thr_detach() calls on tids[j] + offset
+ *
+ *  @return Ticks taken
+ */
+static unsigned int time_lookups(int *tids, int n, int offset)
+{
+	unsigned int start = get_ticks();
+	int j;
+
+	for(j = 0; j < LOOKUPS; j++)
+		thr_detach(tids[j % n] + offset);
+	return get_ticks() - start;
+}
+
+int main()
+{
+	int *tids;
+	int i, j, n, created;
+	unsigned int hits, misses;
+
+	thr_init(4 * PAGE_SIZE);
+	thr_stack_lazy(1);
+
+	tids = malloc(sizes[NSIZES - 1] * sizeof(int));
+	if(tids == NULL)
+	{
+		printf("tcb_lookup_bench: out of memory\n");
+		return -1;
+	}
+
+	for(i = 0; i < NSIZES; i++)
+	{
+		n = sizes[i];
+		latch_init(&gate, 1);
+		latch_init(&gone, n);
+
+		for(created = 0; created < n; created++)
+		{
+			tids[created] = thr_create_detached(blocked, NULL);
+			if(tids[created] < 0)
+				break;
+		}
+		for(j = created; j < n; j++)
+			latch_count_down(&gone);
+
+		if(created > 0)
+		{
+			hits = time_lookups(tids, created, 0);
+			misses = time_lookups(tids, created, MISS_OFFSET);
+			printf("%5d threads: %d lookups, hits %u ticks, "
+			       "misses %u ticks\n",
+			       created, LOOKUPS, hits, misses);
+		}
+
+		latch_count_down(&gate);
+		latch_wait(&gone);
+		latch_destroy(&gate);
+		latch_destroy(&gone);
+
+		if(created < n)
+		{
+			printf("only %d of %d threads could be created\n",
+			       created, n);
+			break;
+		}
+	}
+
+	free(tids);
+	return 0;
+}
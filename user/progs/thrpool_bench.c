@@ -0,0 +1,85 @@
+/** @file thrpool_bench.c
+ *
+ *  @brief Runs 10,000 tiny tasks on a thread pool and as one
+ *         thread each
+ *
+ *  The raw version creates its threads in waves of WAVE and joins
+ *  each wave before starting the next, to stay well under the
+ *  kernel's thread limit.
+ *
+ *  @author Ishant & Shelton
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <thrpool.h>
+#include <mutex.h>
+#include <syscall.h>
+
+#define NTASKS 10000
+#define WORKERS 4
+#define QSIZE 256
+#define WAVE 100
+
+static mutex_t count_lock;
+static int count;
+
+static void *tiny(void *arg)
+{
+	mutex_lock(&count_lock);
+	count++;
+	mutex_unlock(&count_lock);
+	return arg;
+}
+
+int main()
+{
+	thrpool_t *pool;
+	int tids[WAVE];
+	int i, n, ran;
+	unsigned int start, ticks;
+
+	thr_init(4 * PAGE_SIZE);
+	mutex_init(&count_lock);
+
+	/* One thread per task */
+	count = 0;
+	start = get_ticks();
+	for(ran = 0; ran < NTASKS; ran += n)
+	{
+		for(n = 0; n < WAVE && ran + n < NTASKS; n++)
+		{
+			tids[n] = thr_create(tiny, NULL);
+			if(tids[n] < 0)
+				break;
+		}
+		for(i = 0; i < n; i++)
+			thr_join(tids[i], NULL);
+		if(n == 0)
+			break;
+	}
+	ticks = get_ticks() - start;
+	printf("thr_create: %d tasks in %u ticks\n", count, ticks);
+
+	/* The same tasks on a pool */
+	pool = thrpool_create(WORKERS, QSIZE);
+	if(pool == NULL)
+	{
+		printf("thrpool_bench: could not create the pool\n");
+		return -1;
+	}
+
+	count = 0;
+	start = get_ticks();
+	for(i = 0; i < NTASKS; i++)
+		thrpool_submit(pool, tiny, NULL);
+	thrpool_wait(pool);
+	ticks = get_ticks() - start;
+	printf("thrpool:    %d tasks in %u ticks on %d workers\n",
+	       count, ticks, WORKERS);
+
+	thrpool_destroy(pool);
+	mutex_destroy(&count_lock);
+	return 0;
+}